@@ -0,0 +1,173 @@
+#include "alias.h"
+#include "parser.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    Alias *alias;       // NULL if empty or a tombstone
+    uint32_t hash;
+    bool tombstone;     // deleted slot, keeps probe chains intact
+} AliasSlot;
+
+static AliasSlot *slots = NULL;
+static size_t slot_cap = 0;     // power of two
+static size_t slot_used = 0;    // live entries
+static size_t slot_filled = 0;  // live entries + tombstones
+
+/* ---------- Hash table ---------- */
+static uint32_t hash_name(const char *s) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static AliasSlot *find_slot(const char *name, uint32_t h) {
+    if (slot_used == 0) return NULL;
+    size_t mask = slot_cap - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        AliasSlot *s = &slots[i];
+        if (!s->alias && !s->tombstone) return NULL;
+        if (s->alias && s->hash == h && strcmp(s->alias->name, name) == 0) return s;
+    }
+}
+
+static void rehash(size_t new_cap) {
+    AliasSlot *old = slots;
+    size_t old_cap = slot_cap;
+
+    slots = calloc(new_cap, sizeof *slots);
+    slot_cap = new_cap;
+    slot_filled = slot_used;
+
+    size_t mask = new_cap - 1;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i].alias) continue;
+        size_t j = old[i].hash & mask;
+        while (slots[j].alias) j = (j + 1) & mask;
+        slots[j] = old[i];
+    }
+    free(old);
+}
+
+static void free_alias(Alias *a) {
+    for (size_t i = 0; i < a->num_tokens; i++) free(a->tokens[i]);
+    free(a->tokens);
+    free(a->name);
+    free(a->value);
+    free(a);
+}
+
+/* ---------- Public API ---------- */
+bool alias_valid_name(const char *name, size_t len) {
+    if (len == 0) return false;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (c <= ' ' || strchr("=/$`'\"\\|&;<>()#", c)) return false;
+    }
+    return true;
+}
+
+bool alias_define(const char *name, const char *value) {
+    if (!alias_valid_name(name, strlen(name))) {
+        fprintf(stderr, "alias: `%s': invalid alias name\n", name);
+        return false;
+    }
+    size_t count = 0;
+    char **tokens = parse_tokens(value, &count);
+    if (!tokens) {
+        fprintf(stderr, "alias: %s: unterminated quote or construct in value\n", name);
+        return false;
+    }
+
+    Alias *a = malloc(sizeof *a);
+    a->name = strdup(name);
+    a->value = strdup(value);
+    a->tokens = tokens;
+    a->num_tokens = count;
+    size_t vlen = strlen(value);
+    a->blank = vlen > 0 && (value[vlen - 1] == ' ' || value[vlen - 1] == '\t');
+
+    uint32_t h = hash_name(name);
+    AliasSlot *s = find_slot(name, h);
+    if (s) {
+        free_alias(s->alias);
+        s->alias = a;
+        return true;
+    }
+
+    // keep load (including tombstones) under 3/4
+    if ((slot_filled + 1) * 4 > slot_cap * 3) {
+        size_t cap = slot_cap ? slot_cap : 32;
+        while ((slot_used + 1) * 2 > cap) cap *= 2;
+        rehash(cap);
+    }
+    size_t mask = slot_cap - 1;
+    size_t i = h & mask;
+    while (slots[i].alias) i = (i + 1) & mask;
+    if (!slots[i].tombstone) slot_filled++;
+    slots[i] = (AliasSlot){ a, h, false };
+    slot_used++;
+    return true;
+}
+
+bool alias_remove(const char *name) {
+    AliasSlot *s = find_slot(name, hash_name(name));
+    if (!s) return false;
+    free_alias(s->alias);
+    s->alias = NULL;
+    s->tombstone = true;
+    slot_used--;
+    return true;
+}
+
+void alias_clear(void) {
+    for (size_t i = 0; i < slot_cap; i++) {
+        if (slots[i].alias) free_alias(slots[i].alias);
+    }
+    free(slots);
+    slots = NULL;
+    slot_cap = slot_used = slot_filled = 0;
+}
+
+const Alias *alias_find(const char *name) {
+    AliasSlot *s = find_slot(name, hash_name(name));
+    return s ? s->alias : NULL;
+}
+
+// alias NAME='VALUE', with ' in VALUE written as '\''
+static void print_one(const Alias *a) {
+    printf("alias %s='", a->name);
+    for (const char *p = a->value; *p; p++) {
+        if (*p == '\'') fputs("'\\''", stdout);
+        else putchar(*p);
+    }
+    fputs("'\n", stdout);
+}
+
+static int cmp_alias(const void *a, const void *b) {
+    return strcmp((*(Alias *const *)a)->name, (*(Alias *const *)b)->name);
+}
+
+bool alias_print(const char *name) {
+    if (name) {
+        const Alias *a = alias_find(name);
+        if (a) print_one(a);
+        return a != NULL;
+    }
+    Alias **list = malloc((slot_used + 1) * sizeof *list);
+    if (!list) return true;
+    size_t n = 0;
+    for (size_t i = 0; i < slot_cap; i++) {
+        if (slots[i].alias) list[n++] = slots[i].alias;
+    }
+    qsort(list, n, sizeof *list, cmp_alias);
+    for (size_t i = 0; i < n; i++) print_one(list[i]);
+    free(list);
+    return true;
+}
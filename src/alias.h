@@ -0,0 +1,42 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Aliases (alias NAME=VALUE, unalias).
+* A value is tokenized once, when it is defined; the parser splices
+* copies of those tokens in place of an unquoted command word naming
+* the alias, so using one costs a hash lookup and no re-tokenizing.
+* As POSIX describes, an alias is not expanded again inside its own
+* substitution, and a value ending in a blank makes the word after it
+* subject to alias substitution too. Reserved words are recognized
+* first, but an alias may expand to one.
+* A definition takes effect from the next line parsed.
+* Stored in an open-addressing hash table (linear probing).
+*/
+
+typedef struct {
+    char *name;
+    char *value;            // as defined, for printing
+    char **tokens;          // value as parser tokens
+    size_t num_tokens;
+    bool blank;             // value ends in a blank: check the next word
+} Alias;
+
+// true if name can be an alias: no quotes, blanks, '=', '/', '$' or operators
+bool alias_valid_name(const char *name, size_t len);
+
+// Define or replace name. false after an error message.
+bool alias_define(const char *name, const char *value);
+bool alias_remove(const char *name);
+void alias_clear(void);
+
+// NULL when name isn't an alias
+const Alias *alias_find(const char *name);
+
+// Print name (or all, sorted when name is NULL) as alias NAME='VALUE';
+// false if name isn't defined
+bool alias_print(const char *name);
+
+#endif // ALIAS_H
@@ -1,5 +1,11 @@
 #include "builtins.h"
 #include "history.h"
+#include "vars.h"
+#include "parsecache.h"
+#include "dirs.h"
+#include "sharedhist.h"
+#include "highlight.h"
+#include "alias.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,35 +13,165 @@
 #include <unistd.h>
 #include <limits.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
 
 extern History history;
 
-bool bi_cd(char **argv) {
+// cd [DIR | -]: logical, like other shells; "-" goes to $OLDPWD
+int bi_cd(char **argv) {
     const char *target = argv[1];
+    bool show = false;
     if (!target) {
-        target = getenv("HOME");
+        target = var_get("HOME");
+        if (!target) {
+            fprintf(stderr, "cd: HOME not set\n");
+            return 1;
+        }
+    } else if (strcmp(target, "-") == 0) {
+        target = var_get("OLDPWD");
+        if (!target) {
+            fprintf(stderr, "cd: OLDPWD not set\n");
+            return 1;
+        }
+        show = true;
     }
-    if (chdir(target) != 0) {
-        perror("cd");
+
+    char *dir = strdup(target);     // OLDPWD is about to change
+    int rc = dirs_chdir(dir);
+    if (rc < 0) {
+        fprintf(stderr, "cd: %s: %s\n", dir, strerror(errno));
+    } else if (show) {
+        puts(dirs_pwd());
     }
-    return true; // handled
+    free(dir);
+    return rc < 0 ? 1 : 0;
 }
 
-bool bi_pwd(char **argv) {
-    (void)argv;
-    char buf[PATH_MAX];
-    if (getcwd(buf, sizeof buf)) {
+// pwd [-L | -P]: the logical $PWD, or the physical path with -P
+int bi_pwd(char **argv) {
+    if (argv[1] && strcmp(argv[1], "-P") == 0) {
+        char buf[PATH_MAX];
+        if (!getcwd(buf, sizeof buf)) {
+            perror("pwd");
+            return 1;
+        }
         puts(buf);
+        return 0;
+    }
+    puts(dirs_pwd());
+    return 0;
+}
+
+// j [FRAGMENT ...]: cd to the best frecency match, or list the index
+int bi_j(char **argv) {
+    if (!argv[1]) {
+        dirs_print_index();
+        return 0;
+    }
+    const char *best = dirs_best_match(argv + 1);
+    if (!best) {
+        fprintf(stderr, "j: no match\n");
+        return 1;
+    }
+    char *dir = strdup(best);       // the index may change while recording
+    int rc = dirs_chdir(dir);
+    if (rc < 0) fprintf(stderr, "j: %s: %s\n", dir, strerror(errno));
+    else puts(dir);
+    free(dir);
+    return rc < 0 ? 1 : 0;
+}
+
+// pushd [DIR]: push the current dir and cd to DIR (no DIR: swap the top two)
+int bi_pushd(char **argv) {
+    char *old = strdup(dirs_pwd());
+    char *target = argv[1] ? strdup(argv[1]) : dirs_stack_pop();
+    if (!target) {
+        fprintf(stderr, "pushd: no other directory\n");
+        free(old);
+        return 1;
+    }
+    int rc = dirs_chdir(target);
+    if (rc < 0) {
+        fprintf(stderr, "pushd: %s: %s\n", target, strerror(errno));
+        if (!argv[1]) dirs_stack_push(target);     // put it back
     } else {
-        perror("pwd");
+        dirs_stack_push(old);
+        dirs_stack_print();
     }
-    return true;
+    free(target);
+    free(old);
+    return rc < 0 ? 1 : 0;
 }
 
-bool bi_prompt(ShellState *st, char **argv) {
+// popd: cd to the top of the stack and drop it
+int bi_popd(char **argv) {
+    (void)argv;
+    const char *top = dirs_stack_top();
+    if (!top) {
+        fprintf(stderr, "popd: directory stack empty\n");
+        return 1;
+    }
+    if (dirs_chdir(top) < 0) {
+        fprintf(stderr, "popd: %s: %s\n", top, strerror(errno));
+        return 1;
+    }
+    free(dirs_stack_pop());
+    dirs_stack_print();
+    return 0;
+}
+
+// dirs [-c]: show the stack, or clear it
+int bi_dirs(char **argv) {
+    if (argv[1] && strcmp(argv[1], "-c") == 0) {
+        dirs_stack_clear();
+        return 0;
+    }
+    dirs_stack_print();
+    return 0;
+}
+
+// echo [-neE] [ARG ...]: -n drops the newline, -e interprets \ escapes
+int bi_echo(char **argv) {
+    bool newline = true, escapes = false;
+    size_t i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; i++) {
+        const char *o = argv[i] + 1;
+        if (strspn(o, "neE") != strlen(o)) break;   // not an option word
+        for (; *o; o++) {
+            if (*o == 'n') newline = false;
+            else escapes = (*o == 'e');
+        }
+    }
+
+    for (bool first = true; argv[i]; i++, first = false) {
+        if (!first) putchar(' ');
+        for (const char *s = argv[i]; *s; s++) {
+            if (!escapes || *s != '\\' || !s[1]) {
+                putchar(*s);
+                continue;
+            }
+            switch (*++s) {
+            case 'n': putchar('\n'); break;
+            case 't': putchar('\t'); break;
+            case 'r': putchar('\r'); break;
+            case 'a': putchar('\a'); break;
+            case 'b': putchar('\b'); break;
+            case 'e': putchar('\033'); break;
+            case '\\': putchar('\\'); break;
+            case 'c': return 0;     // \c: stop output here
+            default: putchar('\\'); putchar(*s); break;
+            }
+        }
+    }
+    if (newline) putchar('\n');
+    return 0;
+}
+
+int bi_prompt(ShellState *st, char **argv) {
     if (!argv[1]) {
         fprintf(stderr, "usage: prompt NEWPROMPT\n");
-        return true;
+        return 2;
     }
 
     // copy base string
@@ -49,16 +185,345 @@ bool bi_prompt(ShellState *st, char **argv) {
         st->prompt[len] = '\0';
     }
 
-    return true;
+    return 0;
 }
 
-bool bi_exit(char **argv) {
-    (void)argv;
-    exit(0);
+int bi_exit(char **argv) {
+    int code = argv[1] ? atoi(argv[1]) : 0;
+    fflush(stdout);
+    exit(code);
 }
 
-bool bi_history(char **argv) {
-    (void)argv;
-    history_print(&history);
+// history -w/-r: FILE, or $HISTFILE
+static const char *history_file(const char *arg) {
+    const char *path = arg ? arg : var_get("HISTFILE");
+    if (!path || !*path) fprintf(stderr, "history: no file given and HISTFILE is not set\n");
+    return path && *path ? path : NULL;
+}
+
+/* history [-m TEXT] [N]   list entries (the last N), only those containing TEXT
+ * history -c              clear
+ * history -d N            delete entry N
+ * history -w [FILE]       write entries to FILE ($HISTFILE)
+ * history -r [FILE]       append FILE's lines ($HISTFILE)
+ */
+int bi_history(char **argv) {
+    const char *opt = argv[1];
+    if (opt && strcmp(opt, "-c") == 0) {
+        history_clear(&history);
+        return 0;
+    }
+    if (opt && strcmp(opt, "-d") == 0) {
+        char *end = NULL;
+        unsigned long n = argv[2] ? strtoul(argv[2], &end, 10) : 0;
+        if (!argv[2] || *end || !history_delete(&history, (size_t)n)) {
+            fprintf(stderr, "history: %s: history position out of range\n",
+                    argv[2] ? argv[2] : "");
+            return 1;
+        }
+        return 0;
+    }
+    if (opt && (strcmp(opt, "-w") == 0 || strcmp(opt, "-r") == 0)) {
+        const char *path = history_file(argv[2]);
+        if (!path) return 1;
+        int rc = opt[1] == 'w' ? history_write(&history, path)
+                               : history_read(&history, path);
+        if (rc < 0) {
+            fprintf(stderr, "history: %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
+    const char *match = NULL;
+    size_t last = 0;
+    for (size_t i = 1; argv[i]; i++) {
+        char *end = NULL;
+        if (strcmp(argv[i], "-m") == 0 && argv[i + 1]) {
+            match = argv[++i];
+        } else if (isdigit((unsigned char)argv[i][0]) &&
+                   (last = (size_t)strtoul(argv[i], &end, 10), *end == '\0')) {
+            continue;
+        } else {
+            fprintf(stderr, "usage: history [-m TEXT] [N] | -c | -d N | -w [FILE] | -r [FILE]\n");
+            return 2;
+        }
+    }
+    history_print(&history, last, match);
+    return 0;
+}
+
+// export [NAME[=value] ...]
+int bi_export(char **argv) {
+    if (!argv[1]) {
+        vars_print(true);
+        return 0;
+    }
+    int status = 0;
+    for (size_t i = 1; argv[i]; i++) {
+        bool ok = strchr(argv[i], '=') ? var_assign(argv[i], true)
+                                       : var_export(argv[i]);
+        if (!ok) {
+            fprintf(stderr, "export: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// unset NAME ...
+int bi_unset(char **argv) {
+    for (size_t i = 1; argv[i]; i++) {
+        var_unset(argv[i]);
+    }
+    return 0;
+}
+
+/* read [-r] [-u FD] [NAME ...]: read one line into NAMEs (default REPLY).
+ * Bytes are taken one at a time so nothing after the newline is used
+ * up: the rest stays in the pipe for the next reader (a coprocess's
+ * output read line by line). Words split on blanks; the last NAME gets
+ * the remainder. Without -r a backslash keeps the next character.
+ */
+int bi_read(char **argv) {
+    bool raw = false;
+    int fd = STDIN_FILENO;
+    size_t i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            raw = true;
+        } else if (strcmp(argv[i], "-u") == 0 && argv[i + 1]) {
+            char *end = NULL;
+            long n = strtol(argv[++i], &end, 10);
+            if (!*argv[i] || *end || n < 0 || fcntl((int)n, F_GETFD) < 0) {
+                fprintf(stderr, "read: %s: invalid file descriptor\n", argv[i]);
+                return 1;
+            }
+            fd = (int)n;
+        } else {
+            fprintf(stderr, "usage: read [-r] [-u FD] [NAME ...]\n");
+            return 2;
+        }
+    }
+
+    size_t len = 0, cap = 128;
+    char *line = malloc(cap);
+    bool complete = false, escaped = false;
+    for (;;) {
+        char c;
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (!raw && !escaped && c == '\\') {
+            escaped = true;
+            continue;
+        }
+        if (c == '\n') {
+            if (!escaped) {
+                complete = true;
+                break;
+            }
+            escaped = false;        // \ newline: line continues
+            continue;
+        }
+        escaped = false;
+        if (len + 1 >= cap) line = realloc(line, cap *= 2);
+        line[len++] = c;
+    }
+    line[len] = '\0';
+
+    char *const reply[] = { "REPLY", NULL };
+    char *const *names = argv[i] ? argv + i : reply;
+    char *p = line;
+    for (size_t k = 0; names[k]; k++) {
+        p += strspn(p, " \t");
+        char *value = p;
+        if (names[k + 1]) {
+            p += strcspn(p, " \t");
+            if (*p) *p++ = '\0';
+        } else {
+            // last name: the rest, without trailing blanks
+            char *end = p + strlen(p);
+            while (end > p && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+        }
+        if (!var_set(names[k], value, false)) {
+            fprintf(stderr, "read: `%s': not a valid identifier\n", names[k]);
+            free(line);
+            return 1;
+        }
+    }
+    free(line);
+    return complete ? 0 : 1;     // end of input: names are still set
+}
+
+/* alias [NAME[=VALUE] ...]: define aliases, or print them (all when
+ * no NAME is given). Cached parses may hold the old expansion, so a
+ * change clears the parse cache.
+ */
+int bi_alias(char **argv) {
+    if (!argv[1]) {
+        alias_print(NULL);
+        return 0;
+    }
+    int status = 0;
+    bool changed = false;
+    for (size_t i = 1; argv[i]; i++) {
+        char *eq = strchr(argv[i], '=');
+        if (!eq) {
+            if (!alias_print(argv[i])) {
+                fprintf(stderr, "alias: %s: not found\n", argv[i]);
+                status = 1;
+            }
+            continue;
+        }
+        *eq = '\0';
+        if (alias_define(argv[i], eq + 1)) changed = true;
+        else status = 1;
+        *eq = '=';
+    }
+    if (changed) pcache_clear();
+    return status;
+}
+
+// unalias -a | NAME ...
+int bi_unalias(char **argv) {
+    if (!argv[1]) {
+        fprintf(stderr, "usage: unalias -a | NAME ...\n");
+        return 2;
+    }
+    int status = 0;
+    if (strcmp(argv[1], "-a") == 0) {
+        alias_clear();
+    } else {
+        for (size_t i = 1; argv[i]; i++) {
+            if (!alias_remove(argv[i])) {
+                fprintf(stderr, "unalias: %s: not found\n", argv[i]);
+                status = 1;
+            }
+        }
+    }
+    pcache_clear();
+    return status;
+}
+
+// parsecache [-s SIZE | -c]: show stats, resize or clear the parse cache
+int bi_parsecache(char **argv) {
+    if (!argv[1]) {
+        pcache_print_stats();
+        return 0;
+    }
+    if (strcmp(argv[1], "-c") == 0) {
+        pcache_clear();
+        return 0;
+    }
+    if (strcmp(argv[1], "-s") == 0 && argv[2]) {
+        char *end = NULL;
+        long size = strtol(argv[2], &end, 10);
+        if (end && *end == '\0' && size >= 0) {
+            pcache_resize((size_t)size);
+            return 0;
+        }
+    }
+    fprintf(stderr, "usage: parsecache [-s SIZE | -c]\n");
+    return 2;
+}
+
+/* ---------- set -o options ---------- */
+
+/* Parse a size like 65536, 64K, 1M or 1G; returns false if invalid,
+ * negative or above INT_MAX (F_SETPIPE_SZ takes an int)
+ */
+static bool parse_size(const char *s, size_t *out) {
+    if (!isdigit((unsigned char)*s)) return false;
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno) return false;
+    int shift = 0;
+    switch (toupper((unsigned char)*end)) {
+    case 'K': shift = 10; end++; break;
+    case 'M': shift = 20; end++; break;
+    case 'G': shift = 30; end++; break;
+    default: break;
+    }
+    if (*end != '\0' || v > ((unsigned long long)INT_MAX >> shift)) return false;
+    *out = (size_t)(v << shift);
     return true;
 }
+
+// Capacity the kernel grants for a requested pipe size (0 = default)
+static size_t probe_pipe_size(size_t want) {
+    int fds[2];
+    if (pipe(fds) < 0) return 0;
+    long got = 0;
+#ifdef F_SETPIPE_SZ
+    if (want > 0 && fcntl(fds[1], F_SETPIPE_SZ, (int)want) < 0) {
+        perror("set: pipebuf");
+    }
+    got = fcntl(fds[1], F_GETPIPE_SZ);
+#else
+    (void)want;
+#endif
+    close(fds[0]);
+    close(fds[1]);
+    return got > 0 ? (size_t)got : 0;
+}
+
+static void print_options(const ShellState *st) {
+    printf("pipebuf  %zu (effective %zu)\n", st->pipe_buf, st->pipe_buf_effective);
+    printf("pipepin  %s\n", st->pipe_pin ? "on" : "off");
+    printf("sharehist %s\n", shist_enabled() ? "on" : "off");
+    printf("highlight %s\n", hl_enabled() ? "on" : "off");
+}
+
+/* set            - list shell variables
+ * set -o         - show options
+ * set -o pipebuf=SIZE
+ * set -o pipepin / set +o pipepin
+ * set -o sharehist / set +o sharehist
+ * set -o highlight / set +o highlight
+ */
+int bi_set(ShellState *st, char **argv) {
+    if (!argv[1]) {
+        vars_print(false);
+        return 0;
+    }
+    bool on = strcmp(argv[1], "-o") == 0;
+    if (!on && strcmp(argv[1], "+o") != 0) {
+        fprintf(stderr, "usage: set [-o|+o] [OPTION[=VALUE]]\n");
+        return 2;
+    }
+    if (!argv[2]) {
+        if (st->pipe_buf_effective == 0) {
+            st->pipe_buf_effective = probe_pipe_size(st->pipe_buf);
+        }
+        print_options(st);
+        return 0;
+    }
+
+    int status = 0;
+    for (size_t i = 2; argv[i]; i++) {
+        const char *opt = argv[i];
+        if (strncmp(opt, "pipebuf=", 8) == 0 || strcmp(opt, "pipebuf") == 0) {
+            size_t size = 0;
+            if (on && opt[7] == '=' && !parse_size(opt + 8, &size)) {
+                fprintf(stderr, "set: invalid size: %s\n", opt + 8);
+                status = 1;
+                continue;
+            }
+            st->pipe_buf = size;
+            st->pipe_buf_effective = probe_pipe_size(size);
+        } else if (strcmp(opt, "pipepin") == 0) {
+            st->pipe_pin = on;
+        } else if (strcmp(opt, "sharehist") == 0) {
+            if (!on) shist_close();
+            else if (!shist_open(&history)) status = 1;
+        } else if (strcmp(opt, "highlight") == 0) {
+            hl_set_enabled(on);
+        } else {
+            fprintf(stderr, "set: %s: invalid option name\n", opt);
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -4,18 +4,40 @@
 #include "history.h"
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 extern History history;
 
 typedef struct {
     char prompt[256];
+    int last_status;    // exit status of the last job ($?)
+    pid_t shell_pid;    // pid of the shell itself ($$)
+    char **params;      // positional parameters $1..
+    size_t num_params;  // $#
+    size_t pipe_buf;    // set -o pipebuf: pipe capacity in bytes (0 = default)
+    size_t pipe_buf_effective; // capacity the kernel actually granted
+    bool pipe_pin;      // set -o pipepin: pin pipeline stages to sibling cores
+    size_t bg_jobs;     // background processes not yet reaped (\j)
 } ShellState;
 
-bool bi_cd(char **argv);
-bool bi_pwd(char **argv);
-bool bi_prompt(ShellState *st, char **argv);
-bool bi_exit(char **argv);
-bool bi_history(char **argv); // stub
+/* Builtins return an exit status (0 on success) */
+int bi_cd(char **argv);
+int bi_pwd(char **argv);
+int bi_echo(char **argv);
+int bi_j(char **argv);
+int bi_pushd(char **argv);
+int bi_popd(char **argv);
+int bi_dirs(char **argv);
+int bi_prompt(ShellState *st, char **argv);
+int bi_exit(char **argv);
+int bi_history(char **argv);
+int bi_export(char **argv);
+int bi_unset(char **argv);
+int bi_read(char **argv);
+int bi_alias(char **argv);
+int bi_unalias(char **argv);
+int bi_parsecache(char **argv);
+int bi_set(ShellState *st, char **argv);
 
 #endif // BUILTINS.H
 
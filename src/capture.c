@@ -0,0 +1,307 @@
+#include "capture.h"
+#include "builtins.h"
+#include "dirs.h"
+#include "executor.h"
+#include "parsecache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CAP_MAGIC   "mycap"
+#define CAP_VERSION 1
+
+extern ShellState shell_state;
+
+static FILE *log_file = NULL;
+static bool measuring = false;
+static uint64_t phase_ns[CAP_NUM_PHASES];
+static uint64_t begin_ns;           // monotonic, when the line was accepted
+static uint64_t begin_us;           // wall clock, likewise
+static uint64_t prev_us;            // wall clock of the previous record
+static char *begin_cwd = NULL;     // where the line started: replay runs it there
+static char *last_cwd = NULL;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+uint64_t cap_now(void) {
+    return measuring ? mono_ns() : 0;
+}
+
+void cap_add(CapPhase phase, uint64_t since) {
+    if (since) phase_ns[phase] += mono_ns() - since;
+}
+
+void cap_begin(void) {
+    if (!measuring) return;
+    memset(phase_ns, 0, sizeof phase_ns);
+    begin_ns = mono_ns();
+    begin_us = wall_us();
+    const char *cwd = dirs_pwd();
+    free(begin_cwd);
+    begin_cwd = cwd ? strdup(cwd) : NULL;
+}
+
+/* ---------- Writing ---------- */
+
+static void put_varint(FILE *f, uint64_t v) {
+    while (v >= 0x80) {
+        putc((int)(v & 0x7f) | 0x80, f);
+        v >>= 7;
+    }
+    putc((int)v, f);
+}
+
+static void put_str(FILE *f, const char *s) {
+    size_t n = strlen(s);
+    put_varint(f, n);
+    fwrite(s, 1, n, f);
+}
+
+bool cap_open(const char *path) {
+    log_file = fopen(path, "wbe");
+    if (!log_file) {
+        fprintf(stderr, "capture: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    prev_us = wall_us();
+    fwrite(CAP_MAGIC, 1, sizeof CAP_MAGIC - 1, log_file);
+    putc(CAP_VERSION, log_file);
+    put_varint(log_file, prev_us);
+    fflush(log_file);
+    measuring = true;
+    return true;
+}
+
+void cap_close(void) {
+    if (log_file) fclose(log_file);
+    log_file = NULL;
+    measuring = false;
+    free(last_cwd);
+    last_cwd = NULL;
+    free(begin_cwd);
+    begin_cwd = NULL;
+}
+
+void cap_end(const char *line, int status) {
+    if (!log_file) return;
+    uint64_t total = mono_ns() - begin_ns;
+    const char *cwd = begin_cwd;
+    bool moved = cwd && (!last_cwd || strcmp(cwd, last_cwd) != 0);
+
+    putc(moved ? 1 : 0, log_file);
+    put_varint(log_file, begin_us > prev_us ? begin_us - prev_us : 0);
+    prev_us = begin_us;
+    if (moved) {
+        put_str(log_file, cwd);
+        free(last_cwd);
+        last_cwd = strdup(cwd);
+    }
+    put_str(log_file, line);
+    put_varint(log_file, (uint64_t)status);
+    for (int p = 0; p < CAP_NUM_PHASES; p++) put_varint(log_file, phase_ns[p] / 1000);
+    put_varint(log_file, total / 1000);
+    fflush(log_file);       // a record per command: nothing lost on a crash
+}
+
+/* ---------- Reading ---------- */
+
+typedef struct {
+    uint64_t gap_us;        // since the previous command was accepted
+    char *cwd;              // NULL: same as before
+    char *line;
+    int status;
+    uint64_t us[CAP_NUM_PHASES + 1];   // phases, then total
+} Record;
+
+typedef struct {
+    const unsigned char *p, *end;
+    bool bad;
+} Reader;
+
+static uint64_t get_varint(Reader *r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->p >= r->end) break;
+        unsigned char b = *r->p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    r->bad = true;
+    return 0;
+}
+
+static char *get_str(Reader *r) {
+    uint64_t n = get_varint(r);
+    if (r->bad || n > (uint64_t)(r->end - r->p)) {
+        r->bad = true;
+        return NULL;
+    }
+    char *s = strndup((const char *)r->p, (size_t)n);
+    r->p += n;
+    return s;
+}
+
+static unsigned char *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rbe");
+    if (!f) return NULL;
+    size_t cap = 65536, n = 0, got;
+    unsigned char *buf = malloc(cap);
+    while (buf && (got = fread(buf + n, 1, cap - n, f)) > 0) {
+        n += got;
+        if (n < cap) continue;
+        unsigned char *tmp = realloc(buf, cap *= 2);
+        if (!tmp) free(buf);
+        buf = tmp;
+    }
+    fclose(f);
+    *len = n;
+    return buf;
+}
+
+// All records of a log; false (message printed) if it isn't one
+static bool load_log(const char *path, Record **out, size_t *count) {
+    size_t len = 0;
+    unsigned char *data = read_file(path, &len);
+    if (!data) {
+        fprintf(stderr, "replay: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    Reader r = { data, data + len, false };
+    size_t magic = sizeof CAP_MAGIC - 1;
+    if (len < magic + 1 || memcmp(data, CAP_MAGIC, magic) != 0 || data[magic] != CAP_VERSION) {
+        fprintf(stderr, "replay: %s: not a capture log\n", path);
+        free(data);
+        return false;
+    }
+    r.p += magic + 1;
+    get_varint(&r);         // start time
+
+    Record *recs = NULL;
+    size_t n = 0, cap = 0;
+    while (r.p < r.end && !r.bad) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            recs = realloc(recs, cap * sizeof *recs);
+        }
+        Record *rec = &recs[n];
+        memset(rec, 0, sizeof *rec);
+        unsigned flags = *r.p++;
+        rec->gap_us = get_varint(&r);
+        if (flags & 1) rec->cwd = get_str(&r);
+        rec->line = get_str(&r);
+        rec->status = (int)get_varint(&r);
+        for (int p = 0; p <= CAP_NUM_PHASES; p++) rec->us[p] = get_varint(&r);
+        if (r.bad) {
+            // a record cut short (the shell died mid-write): stop there
+            free(rec->cwd);
+            free(rec->line);
+            break;
+        }
+        n++;
+    }
+    free(data);
+    *out = recs;
+    *count = n;
+    return true;
+}
+
+/* ---------- Replay ---------- */
+
+static void sleep_until(uint64_t due_ns) {
+    struct timespec ts = { (time_t)(due_ns / 1000000000u), (long)(due_ns % 1000000000u) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+static double change(uint64_t before, uint64_t after) {
+    return before ? ((double)after - (double)before) * 100.0 / (double)before : 0;
+}
+
+static void report(const char *path, const Record *recs, const Record *again, size_t n,
+                   double speed) {
+    static const char *const names[] = { "parse", "expand", "spawn", "wait", "total" };
+    fprintf(stderr, "\nreplay of %s: %zu commands, ", path, n);
+    if (speed > 0) fprintf(stderr, "pacing %gx\n", speed);
+    else fprintf(stderr, "back to back\n");
+    fprintf(stderr, "%5s %11s %11s %8s  %s\n", "#", "orig ms", "replay ms", "change", "command");
+
+    uint64_t sum[2][CAP_NUM_PHASES + 1] = { { 0 } };
+    size_t mismatched = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t a = recs[i].us[CAP_NUM_PHASES], b = again[i].us[CAP_NUM_PHASES];
+        char shown[41];
+        size_t k = 0;
+        for (const char *s = recs[i].line; *s && k < sizeof shown - 1; s++) {
+            shown[k++] = *s == '\n' ? ' ' : *s;
+        }
+        shown[k] = '\0';
+        fprintf(stderr, "%5zu %11.3f %11.3f %+7.1f%%  %s%s\n", i + 1, (double)a / 1e3,
+                (double)b / 1e3, change(a, b), shown,
+                recs[i].status != again[i].status ? "  [status differs]" : "");
+        mismatched += recs[i].status != again[i].status;
+        for (int p = 0; p <= CAP_NUM_PHASES; p++) {
+            sum[0][p] += recs[i].us[p];
+            sum[1][p] += again[i].us[p];
+        }
+    }
+
+    fprintf(stderr, "\n%-8s %11s %11s %8s\n", "phase", "orig ms", "replay ms", "change");
+    for (int p = 0; p <= CAP_NUM_PHASES; p++) {
+        fprintf(stderr, "%-8s %11.3f %11.3f %+7.1f%%\n", names[p], (double)sum[0][p] / 1e3,
+                (double)sum[1][p] / 1e3, change(sum[0][p], sum[1][p]));
+    }
+    if (mismatched) fprintf(stderr, "%zu commands exited differently\n", mismatched);
+}
+
+int cap_replay(const char *path, double speed) {
+    Record *recs = NULL;
+    size_t n = 0;
+    if (!load_log(path, &recs, &n)) return 1;
+    Record *again = calloc(n ? n : 1, sizeof *again);
+
+    measuring = true;
+    uint64_t prev_start = 0;
+    for (size_t i = 0; i < n; i++) {
+        const Record *rec = &recs[i];
+        if (i > 0 && speed > 0) sleep_until(prev_start + (uint64_t)((double)rec->gap_us * 1e3 / speed));
+        prev_start = mono_ns();
+        if (rec->cwd && dirs_chdir(rec->cwd) < 0) {
+            fprintf(stderr, "replay: cd %s: %s\n", rec->cwd, strerror(errno));
+        }
+
+        cap_begin();
+        uint64_t t = cap_now();
+        JobList *list = pcache_parse(rec->line);
+        cap_add(CAP_PARSE, t);
+        int status = list->error || list->incomplete ? 2 : execute_list(list);
+        pcache_release(list);
+        shell_state.last_status = status;
+        fflush(stdout);
+
+        again[i].status = status;
+        for (int p = 0; p < CAP_NUM_PHASES; p++) again[i].us[p] = phase_ns[p] / 1000;
+        again[i].us[CAP_NUM_PHASES] = (mono_ns() - begin_ns) / 1000;
+    }
+    measuring = false;
+
+    report(path, recs, again, n, speed);
+    for (size_t i = 0; i < n; i++) {
+        free(recs[i].cwd);
+        free(recs[i].line);
+    }
+    free(recs);
+    free(again);
+    return shell_state.last_status;
+}
@@ -0,0 +1,49 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Workload capture and replay.
+*   myshell --capture LOG [SCRIPT]    record every accepted command line
+*   myshell --replay LOG [--speed X]  run a recorded session again
+* A record holds the line, when it was accepted, the cwd it started in
+* (only when that changed), its exit status and the time it spent in
+* each phase: parse, expand (words and substitutions), spawn (fork in
+* the parent), wait (for foreground children) and in total. Numbers are LEB128 varints
+* and times microseconds, so a record is the line plus ~10 bytes.
+* Replay keeps the original gaps between commands divided by X (1 by
+* default; 0 runs back to back), measures the same phases and prints a
+* per-command and per-phase comparison to stderr.
+* Timing costs a clock read per phase boundary, and only while a
+* capture or replay is running.
+*/
+
+typedef enum {
+    CAP_PARSE,
+    CAP_EXPAND,
+    CAP_SPAWN,
+    CAP_WAIT,
+    CAP_NUM_PHASES
+} CapPhase;
+
+// Start recording to path (truncated); false after an error message
+bool cap_open(const char *path);
+void cap_close(void);
+
+// Monotonic nanoseconds while measuring, else 0
+uint64_t cap_now(void);
+
+// Add the time since `since` (from cap_now) to phase
+void cap_add(CapPhase phase, uint64_t since);
+
+// A command line was accepted: its phase times start from zero
+void cap_begin(void);
+
+// ... and has run: record it with its status
+void cap_end(const char *line, int status);
+
+// Run the session in path; returns the last command's status
+int cap_replay(const char *path, double speed);
+
+#endif // CAPTURE_H
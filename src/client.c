@@ -0,0 +1,176 @@
+/* myshell-client: thin client for `myshell --server`.
+* Sends its stdin/stdout/stderr, cwd, environment and one command line
+* to the server, forwards Ctrl-C and friends to the worker, and exits
+* with the command's status.
+*/
+#include "server.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern char **environ;
+
+static volatile sig_atomic_t worker_pgid = 0;
+static volatile sig_atomic_t forwarded = 0;     // last signal passed on
+
+static void forward_signal(int sig) {
+    forwarded = sig;
+    if (worker_pgid > 0) kill(-(pid_t)worker_pgid, sig);
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof addr) < 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Append s and its terminating NUL to the payload
+static int push_str(char **buf, size_t *len, size_t *cap, const char *s) {
+    size_t n = strlen(s) + 1;
+    if (*len + n > *cap) {
+        size_t ncap = *cap ? *cap * 2 : 4096;
+        while (ncap < *len + n) ncap *= 2;
+        char *tmp = realloc(*buf, ncap);
+        if (!tmp) return -1;
+        *buf = tmp;
+        *cap = ncap;
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    return 0;
+}
+
+static int send_request(int sock, const char *command) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof cwd)) {
+        perror("getcwd");
+        return -1;
+    }
+
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    int rc = push_str(&buf, &len, &cap, cwd) | push_str(&buf, &len, &cap, command);
+    for (size_t i = 0; environ[i] && rc == 0; i++) {
+        rc = push_str(&buf, &len, &cap, environ[i]);
+    }
+    if (rc < 0 || len > SERVER_MAX_PAYLOAD) {
+        fprintf(stderr, "myshell-client: request too large\n");
+        free(buf);
+        return -1;
+    }
+
+    // first message: our stdio fds plus the payload length
+    uint32_t len32 = (uint32_t)len;
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    struct iovec iov = { &len32, sizeof len32 };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof fds)];
+    } ctl;
+    memset(&ctl, 0, sizeof ctl);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof ctl.buf;
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof fds);
+    memcpy(CMSG_DATA(c), fds, sizeof fds);
+
+    if (sendmsg(sock, &msg, 0) < 0) {
+        perror("sendmsg");
+        free(buf);
+        return -1;
+    }
+    for (size_t off = 0; off < len; ) {
+        ssize_t n = write(sock, buf + off, len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            perror("write");
+            free(buf);
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    free(buf);
+    return 0;
+}
+
+static int read_int(int sock, int32_t *v) {
+    size_t got = 0;
+    while (got < sizeof *v) {
+        ssize_t n = read(sock, (char *)v + got, sizeof *v - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+// usage: myshell-client [-s SOCKET] COMMAND
+int main(int argc, char **argv) {
+    const char *path = getenv("MYSHELL_SOCKET");
+    int i = 1;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        path = argv[2];
+        i = 3;
+    }
+    if (!path || i + 1 != argc) {
+        fprintf(stderr, "usage: myshell-client [-s SOCKET] COMMAND\n");
+        return 2;
+    }
+
+    // signals that arrive before the worker's pid is known stay pending
+    // until it is, then go to the worker like any later ones
+    static const int forwarded_sigs[] = { SIGINT, SIGQUIT, SIGTERM, SIGHUP };
+    sigset_t block, old;
+    sigemptyset(&block);
+    for (size_t k = 0; k < sizeof forwarded_sigs / sizeof *forwarded_sigs; k++) {
+        sigaddset(&block, forwarded_sigs[k]);
+        signal(forwarded_sigs[k], forward_signal);
+    }
+    sigprocmask(SIG_BLOCK, &block, &old);
+    signal(SIGPIPE, SIG_IGN);   // a refused connection is a write error
+
+    int sock = connect_to(path);
+    if (sock < 0 || send_request(sock, argv[i]) < 0) return 255;
+
+    int32_t pid, status;
+    if (read_int(sock, &pid) < 0 || pid <= 0) {
+        fprintf(stderr, "myshell-client: server failed to start the command\n");
+        return 255;
+    }
+    worker_pgid = pid;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    if (read_int(sock, &status) < 0) {
+        // the worker died from a signal we forwarded: exit like it did
+        if (forwarded) return 128 + forwarded;
+        fprintf(stderr, "myshell-client: connection lost\n");
+        return 255;
+    }
+    return status;
+}
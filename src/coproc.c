@@ -0,0 +1,97 @@
+#include "coproc.h"
+#include "vars.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    char *name;
+    pid_t pid;              // 0 once reaped
+    int fds[2];             // shell's read and write ends, -1 once closed
+    char text[2][16];       // the fds as ${NAME[0]} and ${NAME[1]}
+} Coproc;
+
+static Coproc *table = NULL;
+static size_t count = 0;
+
+static Coproc *find_name(const char *name, size_t len) {
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(table[i].name) == len && strncmp(table[i].name, name, len) == 0) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+static void close_end(Coproc *c, int which) {
+    if (c->fds[which] >= 0) close(c->fds[which]);
+    c->fds[which] = -1;
+    c->text[which][0] = '\0';
+}
+
+// NAME_PID
+static void set_pid_var(const char *name, pid_t pid) {
+    size_t len = strlen(name);
+    char var[len + sizeof "_PID"];
+    memcpy(var, name, len);
+    memcpy(var + len, "_PID", sizeof "_PID");
+    if (pid > 0) {
+        char num[16];
+        snprintf(num, sizeof num, "%d", (int)pid);
+        var_set(var, num, false);
+    } else {
+        var_unset(var);
+    }
+}
+
+void coproc_add(const char *name, pid_t pid, int read_fd, int write_fd) {
+    Coproc *c = find_name(name, strlen(name));
+    if (c) {
+        // a new coprocess under an old name: the old one's ends go
+        if (c->pid > 0) {
+            fprintf(stderr, "coproc: warning: %s (pid %d) still running\n",
+                    name, (int)c->pid);
+        }
+        close_end(c, 0);
+        close_end(c, 1);
+    } else {
+        Coproc *tmp = realloc(table, (count + 1) * sizeof *tmp);
+        if (!tmp) {
+            close(read_fd);
+            close(write_fd);
+            return;
+        }
+        table = tmp;
+        c = &table[count++];
+        c->name = strdup(name);
+    }
+    c->pid = pid;
+    c->fds[0] = read_fd;
+    c->fds[1] = write_fd;
+    snprintf(c->text[0], sizeof c->text[0], "%d", read_fd);
+    snprintf(c->text[1], sizeof c->text[1], "%d", write_fd);
+
+    // $NAME is ${NAME[0]}, as in other shells
+    var_set(name, c->text[0], false);
+    set_pid_var(name, pid);
+}
+
+bool coproc_reaped(pid_t pid) {
+    for (size_t i = 0; i < count; i++) {
+        Coproc *c = &table[i];
+        if (c->pid != pid) continue;
+        c->pid = 0;
+        close_end(c, 1);
+        set_pid_var(c->name, 0);
+        return true;
+    }
+    return false;
+}
+
+const char *coproc_element(const char *name, size_t len, size_t index) {
+    Coproc *c = find_name(name, len);
+    if (!c || index > 1 || c->fds[index] < 0) return NULL;
+    return c->text[index];
+}
@@ -0,0 +1,32 @@
+#ifndef COPROC_H
+#define COPROC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Coprocesses: `coproc [NAME] command` starts command once in the
+* background with its stdin and stdout on two pipes, and keeps the other
+* ends open in the shell for later commands:
+*   ${NAME[0]}   read what the coprocess writes  (read -u ${NAME[0]} line)
+*   ${NAME[1]}   write to its input               (echo 1+1 >&${NAME[1]})
+*   $NAME_PID    its pid
+* NAME defaults to COPROC, and must be given before a compound command.
+* The shell's ends are close-on-exec and moved above fd 10, so other
+* children neither inherit them nor have them clobbered by N> redirects.
+* Coprocesses are kept in a table the background reaper checks: when one
+* exits its input end is closed and ${NAME[1]} goes away, while
+* ${NAME[0]} stays readable until the name is reused, so the last of its
+* output can still be collected.
+*/
+
+// Record a started coprocess and set its variables; takes the two fds
+void coproc_add(const char *name, pid_t pid, int read_fd, int write_fd);
+
+// Called for every reaped background pid; true if it was a coprocess
+bool coproc_reaped(pid_t pid);
+
+// ${NAME[index]} for a coprocess NAME (name not NUL-terminated), or NULL
+const char *coproc_element(const char *name, size_t len, size_t index);
+
+#endif // COPROC_H
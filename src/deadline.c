@@ -0,0 +1,207 @@
+#include "deadline.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+typedef struct {
+    pid_t pid;
+    double due;             // monotonic seconds; < 0 once nothing is left to send
+    int sig;
+    double kill_after;
+    DeadlineOutcome fired;
+} Deadline;
+
+static Deadline *table = NULL;
+static size_t count = 0;
+
+static double now_secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static Deadline *find(pid_t pid) {
+    for (size_t i = 0; i < count; i++) {
+        if (table[i].pid == pid) return &table[i];
+    }
+    return NULL;
+}
+
+static void drop(Deadline *d) {
+    *d = table[--count];
+}
+
+/* ---------- Parsing ---------- */
+
+// 1.5, 30s, 2m, 1h, 1d
+static bool parse_duration(const char *s, double *out) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || !(v >= 0)) return false;
+    switch (*end) {
+    case '\0':
+    case 's': break;
+    case 'm': v *= 60; break;
+    case 'h': v *= 3600; break;
+    case 'd': v *= 86400; break;
+    default: return false;
+    }
+    if (*end && end[1]) return false;
+    *out = v;
+    return true;
+}
+
+static const struct {
+    const char *name;
+    int sig;
+} signals[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT },
+    { "KILL", SIGKILL }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 },
+    { "PIPE", SIGPIPE }, { "ALRM", SIGALRM }, { "TERM", SIGTERM },
+    { "CONT", SIGCONT }, { "STOP", SIGSTOP },
+};
+
+// TERM, SIGTERM or 15
+static int parse_signal(const char *s) {
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (end != s && *end == '\0') return n > 0 && n < NSIG ? (int)n : -1;
+    if (strncasecmp(s, "SIG", 3) == 0) s += 3;
+    for (size_t i = 0; i < sizeof signals / sizeof *signals; i++) {
+        if (strcasecmp(s, signals[i].name) == 0) return signals[i].sig;
+    }
+    return -1;
+}
+
+int deadline_parse(char **argv, DeadlineSpec *spec) {
+    spec->sig = SIGTERM;
+    spec->kill_after = 0;
+    int i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        const char *opt = argv[i];
+        const char *val = argv[i + 1];
+        if (strcmp(opt, "-s") == 0 && val) {
+            spec->sig = parse_signal(val);
+            if (spec->sig < 0) return 0;
+        } else if (strcmp(opt, "-k") == 0 && val) {
+            if (!parse_duration(val, &spec->kill_after)) return 0;
+        } else {
+            return 0;       // --foreground, --preserve-status, -v, ...
+        }
+        i++;
+    }
+    if (!argv[i] || !parse_duration(argv[i], &spec->secs)) return 0;
+    return i + 1;
+}
+
+/* ---------- Table ---------- */
+
+void deadline_add(pid_t pid, const DeadlineSpec *spec) {
+    if (spec->secs <= 0) return;    // 0 disables the timeout
+    Deadline *tmp = realloc(table, (count + 1) * sizeof *tmp);
+    if (!tmp) return;
+    table = tmp;
+    table[count++] = (Deadline){
+        pid, now_secs() + spec->secs, spec->sig, spec->kill_after, DEADLINE_NONE
+    };
+}
+
+// The whole group, or just the leader if it has not made one yet
+static void signal_group(pid_t pid, int sig) {
+    if (kill(-pid, sig) < 0) kill(pid, sig);
+}
+
+void deadline_check(void) {
+    if (count == 0) return;
+    double now = now_secs();
+    for (size_t i = 0; i < count; i++) {
+        Deadline *d = &table[i];
+        if (d->due < 0 || d->due > now) continue;
+        if (d->fired == DEADLINE_NONE) {
+            signal_group(d->pid, d->sig);
+            if (d->sig != SIGKILL) signal_group(d->pid, SIGCONT);   // if stopped
+            d->fired = d->sig == SIGKILL ? DEADLINE_KILLED : DEADLINE_SIGNALED;
+            d->due = d->kill_after > 0 && d->sig != SIGKILL ? now + d->kill_after : -1;
+        } else {
+            signal_group(d->pid, SIGKILL);
+            d->fired = DEADLINE_KILLED;
+            d->due = -1;
+        }
+    }
+}
+
+int deadline_next_ms(void) {
+    double next = -1;
+    for (size_t i = 0; i < count; i++) {
+        if (table[i].due >= 0 && (next < 0 || table[i].due < next)) next = table[i].due;
+    }
+    if (next < 0) return -1;
+    double ms = (next - now_secs()) * 1e3;
+    return ms <= 0 ? 0 : ms > 86400e3 ? 86400000 : (int)ms + 1;    // round up
+}
+
+void deadline_reaped(pid_t pid) {
+    Deadline *d = find(pid);
+    if (d) drop(d);
+}
+
+/* ---------- Waiting ---------- */
+
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+pid_t deadline_waitpid(pid_t pid, int *status, DeadlineOutcome *outcome) {
+    int pfd = -1;
+    bool have_pidfd = true;
+    pid_t w;
+    for (;;) {
+        deadline_check();
+        int ms = deadline_next_ms();
+        if (ms >= 0) {
+            // sleep until the child exits or the next deadline is due
+            if (pfd < 0 && have_pidfd) {
+                pfd = open_pidfd(pid);
+                have_pidfd = pfd >= 0;
+            }
+            if (pfd >= 0) {
+                struct pollfd p = { pfd, POLLIN, 0 };
+                if (poll(&p, 1, ms) <= 0) continue;
+            } else {
+                // no pidfds (kernel < 5.3): look every 10ms
+                w = waitpid(pid, status, WNOHANG);
+                if (w != 0 && !(w < 0 && errno == EINTR)) break;
+                poll(NULL, 0, ms < 10 ? ms : 10);
+                continue;
+            }
+        }
+        w = waitpid(pid, status, 0);
+        if (w < 0 && errno == EINTR) continue;
+        break;
+    }
+    if (pfd >= 0) close(pfd);
+
+    Deadline *d = find(pid);
+    *outcome = d ? d->fired : DEADLINE_NONE;
+    if (d && w == pid) drop(d);
+    return w;
+}
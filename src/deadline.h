@@ -0,0 +1,53 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Deadlines for `timeout [-s SIG] [-k KILL_AFTER] DURATION cmd`.
+* The command runs in a child that leads its own process group, so the
+* signal reaches everything it started. No watcher process: the shell
+* keeps a table of deadlines and enforces them wherever it waits, in
+* deadline_waitpid() (poll on a pidfd of the awaited child, with the
+* nearest deadline as the timeout) and, for background jobs, from the
+* line editor's poll and the reaper.
+*/
+
+typedef struct {
+    double secs;            // 0: no deadline
+    int sig;                // sent at the deadline (default SIGTERM)
+    double kill_after;      // then SIGKILL this much later (0: never)
+} DeadlineSpec;
+
+// How a timed command ended
+typedef enum {
+    DEADLINE_NONE,          // exited on its own (or had no deadline)
+    DEADLINE_SIGNALED,      // got spec.sig
+    DEADLINE_KILLED         // got SIGKILL after kill_after
+} DeadlineOutcome;
+
+/* Parse the options and duration after argv[0] ("timeout"). Returns
+* the index of the word after the duration, or 0 for a form only
+* timeout(1) handles (other options, a value this parser doesn't know):
+* the caller then runs the external timeout, as fastcat defers to cat.
+*/
+int deadline_parse(char **argv, DeadlineSpec *spec);
+
+// Start the clock for pid, the leader of its own process group
+void deadline_add(pid_t pid, const DeadlineSpec *spec);
+
+/* waitpid(pid, status, 0) that meanwhile fires every due deadline.
+* *outcome says whether pid itself was timed out.
+*/
+pid_t deadline_waitpid(pid_t pid, int *status, DeadlineOutcome *outcome);
+
+// Milliseconds until the next deadline, or -1 if none is pending
+int deadline_next_ms(void);
+
+// Signal every process group whose deadline has passed
+void deadline_check(void);
+
+// pid was reaped elsewhere (background reaper): forget its deadline
+void deadline_reaped(pid_t pid);
+
+#endif // DEADLINE_H
@@ -0,0 +1,382 @@
+#include "dirs.h"
+#include "prompt.h"
+#include "vars.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define INDEX_MAX_RANK 9000.0   // total rank that triggers aging (as in z)
+#define INDEX_CHECK_SIZE (64 * 1024)    // past this, appends load (and compact) the index
+
+/* ---------- Logical PWD ---------- */
+
+static bool same_file(const char *a, const char *b) {
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 &&
+           sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+void dirs_init(void) {
+    const char *pwd = var_get("PWD");
+    if (pwd && pwd[0] == '/' && same_file(pwd, ".")) {
+        var_set("PWD", pwd, true);
+        return;
+    }
+    char buf[PATH_MAX];
+    if (getcwd(buf, sizeof buf)) var_set("PWD", buf, true);
+}
+
+const char *dirs_pwd(void) {
+    const char *pwd = var_get("PWD");
+    if (pwd) return pwd;
+    dirs_init();
+    pwd = var_get("PWD");
+    return pwd ? pwd : ".";
+}
+
+/* Resolve target against the logical PWD, removing "." and ".."
+ * lexically. Returns a malloc'ed absolute path.
+ */
+static char *logical_path(const char *target) {
+    const char *base = target[0] == '/' ? "" : dirs_pwd();
+    size_t cap = strlen(base) + strlen(target) + 3;
+    char *path = malloc(cap);
+    size_t len = 0;
+    path[0] = '\0';
+
+    // push each component of base then target
+    const char *parts[2] = { base, target };
+    for (int k = 0; k < 2; k++) {
+        const char *p = parts[k];
+        while (*p) {
+            while (*p == '/') p++;
+            const char *end = strchr(p, '/');
+            size_t n = end ? (size_t)(end - p) : strlen(p);
+            if (n == 0 || (n == 1 && p[0] == '.')) {
+                // nothing
+            } else if (n == 2 && p[0] == '.' && p[1] == '.') {
+                while (len > 0 && path[len - 1] != '/') len--;
+                if (len > 0) len--;
+            } else {
+                path[len++] = '/';
+                memcpy(path + len, p, n);
+                len += n;
+            }
+            path[len] = '\0';
+            p += n;
+        }
+    }
+    if (len == 0) strcpy(path, "/");
+    return path;
+}
+
+/* ---------- Frecency index ---------- */
+typedef struct {
+    char *path;
+    double rank;
+    time_t last;
+} DirEntry;
+
+static DirEntry *entries = NULL;
+static size_t num_entries = 0;
+static size_t file_lines = 0;       // lines in the file when loaded
+static bool loaded = false;
+static struct timespec loaded_mtime;
+static off_t loaded_size = 0;
+static bool recording = false;
+
+static const char *index_path(void) {
+    static char path[PATH_MAX];
+    const char *env = var_get("MYSHELL_DIRS");
+    if (env && *env) return env;
+    const char *home = var_get("HOME");
+    if (!home) return NULL;
+    snprintf(path, sizeof path, "%s/.myshell_dirs", home);
+    return path;
+}
+
+static DirEntry *find_entry(const char *path) {
+    for (size_t i = 0; i < num_entries; i++) {
+        if (strcmp(entries[i].path, path) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+static void add_visit(const char *path, double rank, time_t when) {
+    DirEntry *e = find_entry(path);
+    if (!e) {
+        DirEntry *tmp = realloc(entries, (num_entries + 1) * sizeof *tmp);
+        if (!tmp) return;
+        entries = tmp;
+        e = &entries[num_entries++];
+        e->path = strdup(path);
+        e->rank = 0;
+        e->last = 0;
+    }
+    e->rank += rank;
+    if (when > e->last) e->last = when;
+}
+
+static void free_index(void) {
+    for (size_t i = 0; i < num_entries; i++) free(entries[i].path);
+    free(entries);
+    entries = NULL;
+    num_entries = 0;
+}
+
+// Rewrite the file with one aged line per directory (atomic rename)
+static void compact_index(const char *file) {
+    double total = 0;
+    for (size_t i = 0; i < num_entries; i++) total += entries[i].rank;
+    double scale = total > INDEX_MAX_RANK ? 0.99 * INDEX_MAX_RANK / total : 1.0;
+
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof tmp, "%s.%d", file, (int)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    size_t kept = 0;
+    for (size_t i = 0; i < num_entries; i++) {
+        entries[i].rank *= scale;
+        if (entries[i].rank < 1.0) {
+            free(entries[i].path);   // aged out
+            continue;
+        }
+        fprintf(f, "%.2f\t%lld\t%s\n", entries[i].rank,
+                (long long)entries[i].last, entries[i].path);
+        entries[kept++] = entries[i];
+    }
+    num_entries = kept;
+    if (fclose(f) == 0 && rename(tmp, file) == 0) {
+        file_lines = kept;
+    } else {
+        unlink(tmp);
+    }
+}
+
+// (Re)load the index if the file changed since the last load
+static void load_index(void) {
+    const char *file = index_path();
+    if (!file) return;
+    struct stat st;
+    if (stat(file, &st) < 0) {
+        loaded = true;
+        return;
+    }
+    if (loaded && st.st_size == loaded_size &&
+        st.st_mtim.tv_sec == loaded_mtime.tv_sec &&
+        st.st_mtim.tv_nsec == loaded_mtime.tv_nsec) {
+        return;
+    }
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    char *buf = malloc((size_t)st.st_size + 1);
+    ssize_t n = buf ? read(fd, buf, (size_t)st.st_size) : -1;
+    close(fd);
+    if (n < 0) {
+        free(buf);
+        return;
+    }
+    buf[n] = '\0';
+
+    free_index();
+    file_lines = 0;
+    for (char *line = buf; *line; ) {
+        char *nl = strchr(line, '\n');
+        if (nl) *nl = '\0';
+        char *end1 = NULL, *end2 = NULL;
+        double rank = strtod(line, &end1);
+        long long when = end1 && *end1 == '\t' ? strtoll(end1 + 1, &end2, 10) : 0;
+        if (end2 && *end2 == '\t' && end2[1] == '/') {
+            add_visit(end2 + 1, rank, (time_t)when);
+            file_lines++;
+        }
+        if (!nl) break;
+        line = nl + 1;
+    }
+    free(buf);
+
+    loaded = true;
+    loaded_size = st.st_size;
+    loaded_mtime = st.st_mtim;
+    if (file_lines > 2 * num_entries + 64) compact_index(file);
+}
+
+void dirs_set_recording(bool on) {
+    recording = on;
+}
+
+// Append one visit line; O_APPEND keeps concurrent shells' lines whole
+static void record_visit(const char *path) {
+    if (!recording) return;
+    const char *home = var_get("HOME");
+    if (home && strcmp(path, home) == 0) return;
+    const char *file = index_path();
+    if (!file) return;
+
+    time_t now = time(NULL);
+    char line[PATH_MAX + 48];
+    int len = snprintf(line, sizeof line, "1\t%lld\t%s\n", (long long)now, path);
+    if (len <= 0 || (size_t)len >= sizeof line) return;
+
+    int fd = open(file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    off_t before = lseek(fd, 0, SEEK_END);
+    ssize_t w = write(fd, line, (size_t)len);
+    close(fd);
+    if (w == len && loaded && before == loaded_size) {
+        // nobody else appended: update the loaded copy instead of re-reading
+        add_visit(path, 1, now);
+        file_lines++;
+        struct stat st;
+        if (stat(file, &st) == 0) {
+            loaded_size = st.st_size;
+            loaded_mtime = st.st_mtim;
+        }
+    }
+    // a big file is compacted here too, not only when j reads it
+    if (w == len && before + len > INDEX_CHECK_SIZE) load_index();
+}
+
+// z's frecency: rank weighted by how recently the dir was visited
+static double frecency(const DirEntry *e, time_t now) {
+    double age = difftime(now, e->last);
+    if (age < 3600) return e->rank * 4;
+    if (age < 86400) return e->rank * 2;
+    if (age < 604800) return e->rank / 2;
+    return e->rank / 4;
+}
+
+static bool matches(const char *path, char *const *fragments) {
+    const char *p = path;
+    for (size_t i = 0; fragments[i]; i++) {
+        const char *hit = strstr(p, fragments[i]);
+        if (!hit) return false;
+        p = hit + strlen(fragments[i]);
+    }
+    return true;
+}
+
+const char *dirs_best_match(char *const *fragments) {
+    load_index();
+    time_t now = time(NULL);
+    const DirEntry *best = NULL;
+    double best_score = 0;
+    for (size_t i = 0; i < num_entries; i++) {
+        const DirEntry *e = &entries[i];
+        if (!matches(e->path, fragments)) continue;
+        double score = frecency(e, now);
+        if (best && score <= best_score) continue;
+        struct stat st;
+        if (stat(e->path, &st) < 0 || !S_ISDIR(st.st_mode)) continue;   // gone
+        best = e;
+        best_score = score;
+    }
+    return best ? best->path : NULL;
+}
+
+static int cmp_score(const void *a, const void *b) {
+    const double *x = a, *y = b;
+    return (x[0] > y[0]) - (x[0] < y[0]);
+}
+
+void dirs_print_index(void) {
+    load_index();
+    time_t now = time(NULL);
+    // (score, index) pairs sorted by score
+    double (*order)[2] = malloc(num_entries * sizeof *order);
+    if (!order) return;
+    for (size_t i = 0; i < num_entries; i++) {
+        order[i][0] = frecency(&entries[i], now);
+        order[i][1] = (double)i;
+    }
+    qsort(order, num_entries, sizeof *order, cmp_score);
+    for (size_t i = 0; i < num_entries; i++) {
+        printf("%-10.1f %s\n", order[i][0], entries[(size_t)order[i][1]].path);
+    }
+    free(order);
+}
+
+/* ---------- cd ---------- */
+
+int dirs_chdir(const char *target) {
+    char *path = logical_path(target);
+    char *resolved = NULL;
+    if (chdir(path) < 0) {
+        // the logical path doesn't exist (e.g. ".." out of a removed
+        // dir): try the name as given and take the physical path
+        int err = errno;
+        if (chdir(target) < 0) {
+            free(path);
+            errno = err;
+            return -1;
+        }
+        char buf[PATH_MAX];
+        resolved = strdup(getcwd(buf, sizeof buf) ? buf : target);
+        free(path);
+        path = resolved;
+    }
+
+    const char *old = var_get("PWD");
+    if (old) var_set("OLDPWD", old, true);
+    var_set("PWD", path, true);
+    prompt_cwd_changed();
+    record_visit(path);
+    free(path);
+    return 0;
+}
+
+/* ---------- Directory stack ---------- */
+static char **stack = NULL;     // stack[size - 1] is the top
+static size_t stack_size = 0;
+
+void dirs_stack_push(const char *dir) {
+    char **tmp = realloc(stack, (stack_size + 1) * sizeof *tmp);
+    if (!tmp) return;
+    stack = tmp;
+    stack[stack_size++] = strdup(dir);
+}
+
+char *dirs_stack_pop(void) {
+    return stack_size ? stack[--stack_size] : NULL;
+}
+
+const char *dirs_stack_top(void) {
+    return stack_size ? stack[stack_size - 1] : NULL;
+}
+
+size_t dirs_stack_size(void) {
+    return stack_size;
+}
+
+void dirs_stack_clear(void) {
+    while (stack_size) free(stack[--stack_size]);
+}
+
+// Print dir with $HOME abbreviated to ~
+static void print_dir(const char *dir) {
+    const char *home = var_get("HOME");
+    size_t hl = home ? strlen(home) : 0;
+    if (hl > 1 && strncmp(dir, home, hl) == 0 && (dir[hl] == '/' || dir[hl] == '\0')) {
+        printf("~%s", dir + hl);
+    } else {
+        fputs(dir, stdout);
+    }
+}
+
+void dirs_stack_print(void) {
+    print_dir(dirs_pwd());
+    for (size_t i = stack_size; i-- > 0; ) {
+        putchar(' ');
+        print_dir(stack[i]);
+    }
+    putchar('\n');
+}
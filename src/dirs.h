@@ -0,0 +1,50 @@
+#ifndef DIRS_H
+#define DIRS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Working directory tracking.
+* The shell keeps a logical $PWD: cd resolves "." and ".." in the path
+* as typed (symlinks stay in the name, as in other shells), so pwd needs
+* no getcwd(3) walk.
+*
+* In an interactive shell every directory change is appended to a
+* frecency index ($MYSHELL_DIRS, default ~/.myshell_dirs) as one
+* "rank<TAB>time<TAB>path" line: an O(1) append, safe with several
+* shells open. Scripts, -c and server workers record nothing. The index
+* is read with one read(2), duplicate lines are summed, and the file is
+* rewritten compacted (and aged) once the duplicates outnumber the
+* directories, checked when j loads it or an append takes it past 64 KiB.
+*/
+
+// Set $PWD from the environment if it is still correct, else getcwd
+void dirs_init(void);
+
+// Record visits in the index (off until an interactive shell turns it on)
+void dirs_set_recording(bool on);
+
+// Logical working directory
+const char *dirs_pwd(void);
+
+// Change directory (logically), update PWD/OLDPWD, record the visit.
+// Returns 0, or -1 with errno set.
+int dirs_chdir(const char *target);
+
+// Best frecency match for fragments (all present, in order), or NULL
+const char *dirs_best_match(char *const *fragments);
+
+// Print the index, lowest score first
+void dirs_print_index(void);
+
+/* Directory stack for pushd/popd (the top is the current directory and
+* is not stored).
+*/
+void dirs_stack_push(const char *dir);
+char *dirs_stack_pop(void);         // caller frees; NULL if empty
+const char *dirs_stack_top(void);
+size_t dirs_stack_size(void);
+void dirs_stack_clear(void);
+void dirs_stack_print(void);        // like `dirs`: PWD first, ~ for HOME
+
+#endif // DIRS_H
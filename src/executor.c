@@ -1,6 +1,16 @@
 #include "executor.h"
 #include "shelltypes.h"
 #include "builtins.h"
+#include "alias.h"
+#include "capture.h"
+#include "expand.h"
+#include "parser.h"
+#include "vars.h"
+#include "coproc.h"
+#include "fanout.h"
+#include "fastcat.h"
+#include "deadline.h"
+#include "resources.h"
 
 #include <errno.h>
 #include <signal.h>
@@ -9,10 +19,60 @@
 #include <string.h>
 #include <sys/wait.h>
 #include <unistd.h>
-#include <glob.h>
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <termios.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#endif
 
 extern ShellState shell_state;
+extern char **environ;
+
+/* ---------- Control flow state ----------
+ * break/continue/return set a pending count that unwinds
+ * execute_list() and the loops above it.
+ */
+static int loop_depth = 0;          // loops currently executing
+static int pending_break = 0;       // loops left to break out of
+static int pending_continue = 0;    // loops left to unwind, then continue
+static int func_depth = 0;          // function calls currently executing
+static bool pending_return = false;
+
+static bool flow_pending(void) {
+    return pending_break > 0 || pending_continue > 0 || pending_return;
+}
+
+/* ---------- Functions ---------- */
+typedef struct {
+    char *name;
+    Compound *def;      // shared with the parsed tree
+} Function;
+
+static Function *functions = NULL;
+static size_t num_functions = 0;
+
+static const Compound *find_function(const char *name) {
+    for (size_t i = 0; i < num_functions; i++) {
+        if (strcmp(functions[i].name, name) == 0) return functions[i].def;
+    }
+    return NULL;
+}
+
+static void define_function(Compound *def) {
+    for (size_t i = 0; i < num_functions; i++) {
+        if (strcmp(functions[i].name, def->name) == 0) {
+            compound_release(functions[i].def);
+            functions[i].def = compound_retain(def);
+            return;
+        }
+    }
+    functions = realloc(functions, (num_functions + 1) * sizeof *functions);
+    functions[num_functions].name = strdup(def->name);
+    functions[num_functions].def = compound_retain(def);
+    num_functions++;
+}
 
 /* ---------- Helpers ---------- */
 
@@ -22,290 +82,1188 @@ static int is_builtin(const char *name) {
     return (
         strcmp(name, "cd") == 0 ||
         strcmp(name, "pwd") == 0 ||
+        strcmp(name, "echo") == 0 ||
+        strcmp(name, "j") == 0 ||
+        strcmp(name, "pushd") == 0 ||
+        strcmp(name, "popd") == 0 ||
+        strcmp(name, "dirs") == 0 ||
         strcmp(name, "prompt") == 0 ||
         strcmp(name, "exit") == 0 ||
-        strcmp(name, "history") == 0
+        strcmp(name, "history") == 0 ||
+        strcmp(name, "export") == 0 ||
+        strcmp(name, "unset") == 0 ||
+        strcmp(name, "read") == 0 ||
+        strcmp(name, "alias") == 0 ||
+        strcmp(name, "unalias") == 0 ||
+        strcmp(name, "parsecache") == 0 ||
+        strcmp(name, "set") == 0 ||
+        strcmp(name, ":") == 0 ||
+        strcmp(name, "true") == 0 ||
+        strcmp(name, "false") == 0 ||
+        strcmp(name, "break") == 0 ||
+        strcmp(name, "continue") == 0 ||
+        strcmp(name, "return") == 0 ||
+        strcmp(name, "shift") == 0 ||
+        strcmp(name, "ulimit") == 0
+    );
+}
+
+// numeric argument of break/continue/return/shift, or def if absent
+static int count_arg(char **argv, int def) {
+    return argv[1] ? atoi(argv[1]) : def;
+}
+
+static int bi_break(char **argv, bool is_continue) {
+    if (loop_depth == 0) {
+        fprintf(stderr, "%s: only meaningful in a loop\n", argv[0]);
+        return 0;
+    }
+    int n = count_arg(argv, 1);
+    if (n < 1) n = 1;
+    if (n > loop_depth) n = loop_depth;
+    if (is_continue) pending_continue = n;
+    else pending_break = n;
+    return 0;
+}
+
+static int bi_return(char **argv) {
+    if (func_depth == 0) {
+        fprintf(stderr, "return: can only `return' from a function\n");
+        return 1;
+    }
+    pending_return = true;
+    return count_arg(argv, shell_state.last_status);
+}
+
+static int bi_shift(char **argv) {
+    int n = count_arg(argv, 1);
+    if (n < 0 || (size_t)n > shell_state.num_params) return 1;
+    shell_state.params += n;
+    shell_state.num_params -= (size_t)n;
+    return 0;
+}
+
+bool executor_has_command(const char *name) {
+    return is_builtin(name) || find_function(name) != NULL || alias_find(name) != NULL ||
+           strcmp(name, "timeout") == 0 || strcmp(name, "nice") == 0 ||
+           strcmp(name, "cpus") == 0 || strcmp(name, "limit") == 0;
+}
+
+/* history's listing forms only: -c, -d, -w and -r change state, which
+ * in $(...) must stay in a subshell. Words are checked unexpanded, so
+ * one that may expand to an option ($x) is not trusted either.
+ */
+static bool is_history_query(char *const *argv) {
+    for (size_t i = 1; argv[i]; i++) {
+        if (strcmp(argv[i], "-m") == 0 && argv[i + 1]) {
+            i++;
+        } else if (argv[i][0] == '-' || strchr(argv[i], '$') || strchr(argv[i], CTL_CMDSUB)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Builtins that only write to stdout, so $(name ...) can run in the shell
+static int is_capture_builtin(char *const *argv) {
+    const char *name = argv[0];
+    return (
+        strcmp(name, "pwd") == 0 ||
+        strcmp(name, "echo") == 0 ||
+        (strcmp(name, "history") == 0 && is_history_query(argv)) ||
+        strcmp(name, ":") == 0 ||
+        strcmp(name, "true") == 0 ||
+        strcmp(name, "false") == 0
     );
 }
 
-// Run the built in: return 0 if success
+// Run the built in: returns its exit status
 static int run_builtin(char **argv) {
     if (strcmp(argv[0], "cd") == 0) return bi_cd(argv);
     if (strcmp(argv[0], "pwd") == 0) return bi_pwd(argv);
+    if (strcmp(argv[0], "echo") == 0) return bi_echo(argv);
+    if (strcmp(argv[0], "j") == 0) return bi_j(argv);
+    if (strcmp(argv[0], "pushd") == 0) return bi_pushd(argv);
+    if (strcmp(argv[0], "popd") == 0) return bi_popd(argv);
+    if (strcmp(argv[0], "dirs") == 0) return bi_dirs(argv);
     if (strcmp(argv[0], "prompt") == 0) return bi_prompt(&shell_state, argv);
     if (strcmp(argv[0], "exit") == 0) return bi_exit(argv);
     if (strcmp(argv[0], "history") == 0) return bi_history(argv);
+    if (strcmp(argv[0], "export") == 0) return bi_export(argv);
+    if (strcmp(argv[0], "unset") == 0) return bi_unset(argv);
+    if (strcmp(argv[0], "read") == 0) return bi_read(argv);
+    if (strcmp(argv[0], "alias") == 0) return bi_alias(argv);
+    if (strcmp(argv[0], "unalias") == 0) return bi_unalias(argv);
+    if (strcmp(argv[0], "parsecache") == 0) return bi_parsecache(argv);
+    if (strcmp(argv[0], "set") == 0) return bi_set(&shell_state, argv);
+    if (strcmp(argv[0], ":") == 0) return 0;
+    if (strcmp(argv[0], "true") == 0) return 0;
+    if (strcmp(argv[0], "false") == 0) return 1;
+    if (strcmp(argv[0], "break") == 0) return bi_break(argv, false);
+    if (strcmp(argv[0], "continue") == 0) return bi_break(argv, true);
+    if (strcmp(argv[0], "return") == 0) return bi_return(argv);
+    if (strcmp(argv[0], "shift") == 0) return bi_shift(argv);
+    if (strcmp(argv[0], "ulimit") == 0) return res_ulimit(argv);
     return 0;
 }
 
-/* ---------- Wildcard patterns (* or ?) in cmd->argv using glob(3) ---------- */
-static void expand_wildcards(Command *cmd) {
-    if (!cmd || !cmd->argv) return;
-
-    // temporary dynamic list for expanded arguments
-    size_t newcap = 0, newsize = 0;
-    char **newargv = NULL;
-
-    for (size_t i = 0; cmd->argv[i]; i++) {
-        char *arg = cmd->argv[i];
-
-        // check if argument contains * or ?
-        if (strpbrk(arg, "*?")) {
-            glob_t g;
-            memset(&g, 0, sizeof g);
-            
-            int r = glob(arg, 0, NULL, &g);
-            if (r == 0 && g.gl_pathc > 0) {
-                // append all matches
-                for (size_t j = 0; j < g.gl_pathc; j++) {
-                    if (newsize + 1 >= newcap) {
-                        newcap = newcap ? newcap * 2 : 8;
-                        newargv = realloc(newargv, newcap * sizeof *newargv);
-                    }
-                    newargv[newsize++] = strdup(g.gl_pathv[j]);
-                }
-            } else {
-                // no matches: keep the original token
-                if (newsize + 1 >= newcap) {
-                    newcap = newcap ? newcap * 2 : 8;
-                    newargv = realloc(newargv, newcap * sizeof *newargv);
-                }
-                newargv[newsize++] = strdup(arg);
-            }
-            globfree(&g);
+// Convert a waitpid status into a shell exit status
+static int status_from_wait(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+// As status_from_wait, but 124 for a command that hit its deadline
+// (137 if it had to be killed), like timeout(1)
+static int status_from_deadline(int status, DeadlineOutcome timed) {
+    if (timed == DEADLINE_KILLED) return 128 + SIGKILL;
+    if (timed == DEADLINE_SIGNALED) return 124;
+    return status_from_wait(status);
+}
+
+// Wait for a foreground child (enforcing any deadlines) and return its exit status
+static int wait_foreground(pid_t pid) {
+    int status = 0;
+    DeadlineOutcome timed;
+    uint64_t t = cap_now();
+    int r = deadline_waitpid(pid, &status, &timed);
+    cap_add(CAP_WAIT, t);
+    if (r < 0) {
+        perror("waitpid");
+        return 1;
+    }
+
+    // If child was terminated by signal, print newline
+    if (WIFSIGNALED(status) && timed == DEADLINE_NONE) {
+        write(STDOUT_FILENO, "\n", 1);
+    }
+    return status_from_deadline(status, timed);
+}
+
+/* ---------- Command prefixes ----------
+ * timeout, nice, cpus and limit words before a command belong to the
+ * shell: they are stripped here and applied in the child between fork
+ * and exec. A timed command leads its own process group, so its
+ * deadline signal reaches everything it started; in the foreground the
+ * group gets the terminal for the duration (both sides set it, whichever
+ * runs first), so ^C still reaches it.
+ */
+typedef struct {
+    bool timed;
+    DeadlineSpec deadline;
+    bool resources;
+    ResourceSpec res;
+} Prefixes;
+
+/* Returns the index of the command word (0 without prefixes), or -1
+ * after an error message. "timeout" is left as the command, for
+ * timeout(1) to supervise, without a waiting parent (with_timeout
+ * unset) or in a form only timeout(1) knows. With operand set, the
+ * words are the prefixes of a compound command and must all be ours.
+ */
+static int parse_prefixes(char **argv, Prefixes *px, bool with_timeout, bool operand) {
+    px->timed = false;
+    px->resources = false;
+    res_init(&px->res);
+    int i = 0;
+    while (argv[i]) {
+        int k;
+        if (strcmp(argv[i], "timeout") == 0) {
+            k = with_timeout ? deadline_parse(argv + i, &px->deadline) : 0;
+            if (k > 0) px->timed = true;
         } else {
-            // normal argument (no wildcard)
-            if (newsize + 1 >= newcap) {
-                newcap = newcap ? newcap * 2 : 8;
-                newargv = realloc(newargv, newcap * sizeof *newargv);
-            }
-            newargv[newsize++] = strdup(arg);
+            k = res_parse_prefix(argv + i, &px->res);
+            if (k > 0) px->resources = true;
         }
+        if (k < 0) return -1;
+        if (k == 0) break;
+        i += k;
+    }
+    if (operand && argv[i]) {
+        fprintf(stderr, "%s: form not supported before a compound command\n", argv[i]);
+        return -1;
+    }
+    if (!operand && i > 0 && !argv[i]) {
+        // bare `timeout 5` or `nice`: what timeout(1) and nice(1) do
+        if (strcmp(argv[0], "timeout") == 0 || strcmp(argv[0], "nice") == 0) {
+            px->timed = px->resources = false;
+            res_init(&px->res);
+            return 0;
+        }
+        fprintf(stderr, "%s: missing command\n", argv[0]);
+        return -1;
     }
+    return i;
+}
+
+// In the child, before running the command
+static void apply_prefixes(const Prefixes *px) {
+    if (px->timed) setpgid(0, 0);
+    if (px->resources && !res_apply(&px->res)) _exit(126);
+}
+
+static bool owns_terminal(void) {
+    return isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+}
+
+static void set_terminal(pid_t pgid) {
+    void (*old)(int) = signal(SIGTTOU, SIG_IGN);
+    tcsetpgrp(STDIN_FILENO, pgid);
+    signal(SIGTTOU, old);
+}
+
+static void reset_child_signals(void) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+}
 
-    // NULL terminate the new argv
-    if (newsize + 1 >= newcap) {
-        newcap = newcap ? newcap + 1 : 1;
-        newargv = realloc(newargv, newcap * sizeof *newargv);
+/* ---------- I/O redirection ----------
+ * A command's redirections are one table of ops applied in source
+ * order, so "> f 2>&1" and "2>&1 > f" behave like in other shells.
+ */
+
+// open(2) flags for each redirection kind that opens a file
+static int redirect_open_flags(RedirKind kind) {
+    switch (kind) {
+    case REDIR_INPUT:        return O_RDONLY;
+    case REDIR_OUTPUT:
+    case REDIR_OUTPUT_BOTH:  return O_WRONLY | O_CREAT | O_TRUNC;
+    case REDIR_APPEND:
+    case REDIR_APPEND_BOTH:  return O_WRONLY | O_CREAT | O_APPEND;
+    default:                 return -1;
     }
-    newargv[newsize] = NULL;
+}
 
-    // free old argv strings and array, swap in the new one
-    for (size_t i = 0; cmd->argv[i]; i++) free(cmd->argv[i]);
-    free(cmd->argv);
+/* Put inline data (here-document or here-string) behind an fd.
+ * The text is written once into an anonymous memory file: no helper
+ * process, no pipe capacity limit, and the reader can seek.
+ */
+static int open_inline_data(const char *text, size_t len) {
+    int fd;
+#ifdef __linux__
+    fd = memfd_create("myshell-heredoc", MFD_CLOEXEC);
+#else
+    FILE *tmp = tmpfile();
+    fd = tmp ? dup(fileno(tmp)) : -1;
+    if (tmp) fclose(tmp);
+#endif
+    if (fd < 0) return -1;
 
-    cmd->argv = newargv;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t w = write(fd, text + off, len - off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return -1;
+        }
+        off += (size_t)w;
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
 }
 
-/* ---------- Core: run a single command ---------- */
-static int run_single_command(const Command *cmd, int background) {
-    if (!cmd || !cmd->argv || !cmd->argv[0]) {
-        // Empty command - nothing to do
+// Apply one redirection; returns 0 on success, -1 after printing an error
+static int apply_redirection(const Redirection *r) {
+    char *word = expand_word_nosplit(r->target);
+
+    if (r->kind == REDIR_HEREDOC || r->kind == REDIR_HERESTRING) {
+        size_t len = strlen(word);
+        if (r->kind == REDIR_HERESTRING) {
+            word = realloc(word, len + 2);
+            word[len++] = '\n';
+            word[len] = '\0';
+        }
+        int fd = open_inline_data(word, len);
+        free(word);
+        if (fd < 0) {
+            perror("here-document");
+            return -1;
+        }
+        if (fd != r->fd) {
+            dup2(fd, r->fd);
+            close(fd);
+        } else {
+            fcntl(fd, F_SETFD, 0);      // landed on a closed r->fd: keep it past exec
+        }
         return 0;
     }
 
-    // If built in, handle in parent (no fork)
-    if (is_builtin(cmd->argv[0])) {
-        return run_builtin(cmd->argv);
+    if (r->kind == REDIR_DUP) {
+        // N>&M / N<&M duplicate, N>&- closes
+        int rc = 0;
+        if (strcmp(word, "-") == 0) {
+            close(r->fd);
+        } else {
+            char *end = NULL;
+            long src = strtol(word, &end, 10);
+            if (!*word || *end || src < 0 || dup2((int)src, r->fd) < 0) {
+                fprintf(stderr, "%s: bad file descriptor\n", word);
+                rc = -1;
+            }
+        }
+        free(word);
+        return rc;
+    }
+
+    int fd = open(word, redirect_open_flags(r->kind), 0644);
+    if (fd < 0) {
+        perror(word);
+        free(word);
+        return -1;
+    }
+    free(word);
+
+    if (fd != r->fd) {
+        dup2(fd, r->fd);
+        close(fd);
+    }
+    // &> and &>> send stderr to the same open file
+    if (r->kind == REDIR_OUTPUT_BOTH || r->kind == REDIR_APPEND_BOTH) {
+        dup2(r->fd, STDERR_FILENO);
+    }
+    return 0;
+}
+
+/* Multiple outputs (MULTIOS): when one fd is redirected for output more
+ * than once, or a pipeline stage also sends stdout to a file, every
+ * target gets the output. Set by a pipeline stage for its own command.
+ */
+static bool stdout_piped = false;
+
+static bool is_output(const Redirection *r) {
+    return r->kind == REDIR_OUTPUT || r->kind == REDIR_APPEND;
+}
+
+// How many places output on fd goes to
+static size_t output_targets(const Command *cmd, int fd, bool piped) {
+    size_t n = fd == STDOUT_FILENO && piped;
+    for (size_t i = 0; i < cmd->num_redirs; i++) {
+        if (is_output(&cmd->redirs[i]) && cmd->redirs[i].fd == fd) n++;
+    }
+    return n;
+}
+
+static bool has_multios(const Command *cmd) {
+    for (size_t i = 0; i < cmd->num_redirs; i++) {
+        const Redirection *r = &cmd->redirs[i];
+        if (is_output(r) && output_targets(cmd, r->fd, false) > 1) return true;
+    }
+    return false;
+}
+
+// Open every output target of fd and split fd across them
+static int fan_out(const Command *cmd, int fd, bool piped) {
+    int outs[cmd->num_redirs + 1];
+    size_t n = 0;
+    if (fd == STDOUT_FILENO && piped) outs[n++] = dup(STDOUT_FILENO);
+    for (size_t i = 0; i < cmd->num_redirs; i++) {
+        const Redirection *r = &cmd->redirs[i];
+        if (!is_output(r) || r->fd != fd) continue;
+        char *word = expand_word_nosplit(r->target);
+        int out = open(word, redirect_open_flags(r->kind), 0644);
+        if (out < 0) perror(word);
+        free(word);
+        if (out < 0) {
+            while (n > 0) close(outs[--n]);
+            return -1;
+        }
+        outs[n++] = out;
+    }
+    return fanout_start(fd, outs, n);
+}
+
+static void apply_redirections(const Command *cmd) {
+    bool piped = stdout_piped;
+    stdout_piped = false;           // commands run inside this one are not the stage
+    int fanned[cmd->num_redirs + 1];
+    size_t num_fanned = 0;
+    for (size_t i = 0; i < cmd->num_redirs; i++) {
+        const Redirection *r = &cmd->redirs[i];
+        if (is_output(r) && output_targets(cmd, r->fd, piped) > 1) {
+            // all of fd's targets are set up at its first one
+            bool done = false;
+            for (size_t j = 0; j < num_fanned; j++) done |= fanned[j] == r->fd;
+            if (done) continue;
+            if (fan_out(cmd, r->fd, piped) < 0) _exit(1);
+            fanned[num_fanned++] = r->fd;
+            continue;
+        }
+        if (apply_redirection(r) < 0) _exit(1);
+    }
+}
+
+static bool has_redirections(const Command *cmd) {
+    return cmd->num_redirs > 0;
+}
+
+/* Redirections applied in the shell itself (in-shell cat, { } groups):
+ * each fd a redirection replaces is first saved above 10, and
+ * restore_fds() puts the originals back afterwards.
+ */
+typedef struct {
+    int fd;
+    int saved;      // copy of the original, -1 if fd was closed
+} SavedFd;
+
+static void save_fd(SavedFd *saved, size_t *n, int fd) {
+    for (size_t i = 0; i < *n; i++) {
+        if (saved[i].fd == fd) return;
+    }
+    saved[*n].fd = fd;
+    saved[*n].saved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    (*n)++;
+}
+
+static void restore_fds(const SavedFd *saved, size_t n) {
+    fflush(stdout);
+    for (size_t i = n; i-- > 0; ) {
+        if (saved[i].saved >= 0) {
+            dup2(saved[i].saved, saved[i].fd);
+            close(saved[i].saved);
+        } else {
+            close(saved[i].fd);
+        }
+    }
+}
+
+// saved needs room for 2 * num_redirs entries; returns -1 on error
+static int redirect_in_shell(const Command *cmd, SavedFd *saved, size_t *n) {
+    fflush(stdout);
+    *n = 0;
+    for (size_t i = 0; i < cmd->num_redirs; i++) {
+        const Redirection *r = &cmd->redirs[i];
+        save_fd(saved, n, r->fd);
+        if (r->kind == REDIR_OUTPUT_BOTH || r->kind == REDIR_APPEND_BOTH) {
+            save_fd(saved, n, STDERR_FILENO);
+        }
+        if (apply_redirection(r) < 0) return -1;
+    }
+    return 0;
+}
+
+/* ---------- NAME=value prefixes ---------- */
+
+// Set each assignment (value expanded); exported ones go to the child env
+static void apply_assigns(char *const *assigns, bool exported) {
+    if (!assigns) return;
+    for (size_t i = 0; assigns[i]; i++) {
+        char *a = expand_word_nosplit(assigns[i]);
+        var_assign(a, exported);
+        free(a);
+    }
+}
+
+/* Remember the current value of every assigned name ("NAME=value",
+ * or just NAME if unset) so restore_assigns() can put them back.
+ */
+static char **save_assigns(char *const *assigns) {
+    if (!assigns) return NULL;
+    size_t n = 0;
+    while (assigns[n]) n++;
+    char **saved = calloc(n + 1, sizeof *saved);
+    for (size_t i = 0; i < n; i++) {
+        const char *eq = strchr(assigns[i], '=');
+        size_t len = (size_t)(eq - assigns[i]);
+        char *name = strndup(assigns[i], len);
+        const char *old = var_get(name);
+        if (old) {
+            size_t olen = strlen(old);
+            saved[i] = malloc(len + olen + 2);
+            memcpy(saved[i], name, len);
+            saved[i][len] = '=';
+            memcpy(saved[i] + len + 1, old, olen + 1);
+            free(name);
+        } else {
+            saved[i] = name;
+        }
+    }
+    return saved;
+}
+
+static void restore_assigns(char **saved) {
+    if (!saved) return;
+    for (size_t i = 0; saved[i]; i++) {
+        if (strchr(saved[i], '=')) var_assign(saved[i], false);
+        else var_unset(saved[i]);
+    }
+    free_words(saved);
+}
+
+/* ---------- Compound commands ---------- */
+
+// Call a shell function with argv[1..] as its positional parameters
+static int call_function(const Compound *def, char **argv) {
+    char **saved_params = shell_state.params;
+    size_t saved_num = shell_state.num_params;
+    size_t n = 0;
+    while (argv[n + 1]) n++;
+    shell_state.params = argv + 1;
+    shell_state.num_params = n;
+
+    func_depth++;
+    int status = execute_list(&def->body);
+    func_depth--;
+    pending_return = false;
+
+    shell_state.params = saved_params;
+    shell_state.num_params = saved_num;
+    return status;
+}
+
+/* After a loop body: returns 1 if the loop should stop.
+ * break N / continue N unwind one loop level per call.
+ */
+static int loop_should_stop(int status) {
+    if (pending_return) return 1;
+    if (pending_break > 0) {
+        pending_break--;
+        return 1;
+    }
+    if (pending_continue > 0) {
+        pending_continue--;
+        if (pending_continue > 0) return 1;   // continue an outer loop
+    }
+    // ctrl-c in a foreground command stops the loop as well
+    return status == 128 + SIGINT;
+}
+
+static int run_if(const Compound *c) {
+    int status = execute_list(&c->cond);
+    if (flow_pending()) return status;
+    if (status == 0) return execute_list(&c->body);
+    if (c->else_part.count > 0) return execute_list(&c->else_part);
+    return 0;
+}
+
+static int run_loop(const Compound *c, bool until) {
+    int status = 0;
+    loop_depth++;
+    for (;;) {
+        int cond = execute_list(&c->cond);
+        if (flow_pending()) {
+            if (loop_should_stop(cond)) break;
+            continue;
+        }
+        if ((cond == 0) == until) break;
+        status = execute_list(&c->body);
+        if (loop_should_stop(status)) break;
+    }
+    loop_depth--;
+    return status;
+}
+
+static int run_for(const Compound *c) {
+    char **words;
+    if (c->has_in) {
+        words = expand_words(c->words);
+    } else {
+        // no "in" list: iterate over the positional parameters
+        words = calloc(shell_state.num_params + 1, sizeof *words);
+        for (size_t i = 0; i < shell_state.num_params; i++) {
+            words[i] = strdup(shell_state.params[i]);
+        }
+    }
+
+    int status = 0;
+    loop_depth++;
+    for (size_t i = 0; words[i]; i++) {
+        var_set(c->name, words[i], false);
+        status = execute_list(&c->body);
+        if (loop_should_stop(status)) break;
+    }
+    loop_depth--;
+    free_words(words);
+    return status;
+}
+
+static int run_case(const Compound *c) {
+    char *subject = expand_word_nosplit(c->words[0]);
+    int status = 0;
+    for (size_t i = 0; i < c->num_items; i++) {
+        const CaseItem *item = &c->items[i];
+        bool matched = false;
+        for (size_t j = 0; item->patterns[j] && !matched; j++) {
+            char *pat = expand_pattern(item->patterns[j]);
+            matched = fnmatch(pat, subject, 0) == 0;
+            free(pat);
+        }
+        if (matched) {
+            status = execute_list(&item->body);
+            break;
+        }
     }
+    free(subject);
+    return status;
+}
 
-    // Expand any * or ? in arguments
-    expand_wildcards((Command *)cmd);
+static int run_list(const JobList *list, bool tail);
+
+// Shell's end of a coprocess pipe: close-on-exec, above the fds scripts use
+static int coproc_end(int fd) {
+    int high = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if (high < 0) return fd;
+    close(fd);
+    return high;
+}
 
-    // Fork a child to run external program
+/* coproc [NAME] command: runs in its own process group, so ^C meant for
+ * a foreground command doesn't take the long-lived helper with it
+ */
+static int run_coproc(const Compound *c) {
+    int in[2], out[2];      // its stdin, its stdout
+    if (pipe(in) < 0) {
+        perror("coproc: pipe");
+        return 1;
+    }
+    if (pipe(out) < 0) {
+        perror("coproc: pipe");
+        close(in[0]);
+        close(in[1]);
+        return 1;
+    }
+    fflush(stdout);
+    uint64_t t = cap_now();
     pid_t pid = fork();
+    cap_add(CAP_SPAWN, t);
     if (pid < 0) {
         perror("fork");
-        return -1;
+        for (int i = 0; i < 2; i++) {
+            close(in[i]);
+            close(out[i]);
+        }
+        return 1;
     }
-
     if (pid == 0) {
-        /* ---------- Child process ---------- */
-        signal(SIGINT, SIG_DFL);
-        signal(SIGQUIT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        
-        /* ---------- I/O redirection ---------- */
-        if (cmd->input_file) {
-            int fd = open(cmd->input_file, O_RDONLY);
-            if (fd < 0) {
-                perror(cmd->input_file);
-                _exit(1);
-            }
-            dup2(fd, STDIN_FILENO);
-            close(fd);
+        reset_child_signals();
+        setpgid(0, 0);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        for (int i = 0; i < 2; i++) {
+            close(in[i]);
+            close(out[i]);
+        }
+        // the shell waits on each line the body's builtins print
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        _exit(run_list(&c->body, true));
+    }
+    setpgid(pid, pid);
+    close(in[0]);
+    close(out[1]);
+    coproc_add(c->name, pid, coproc_end(out[0]), coproc_end(in[1]));
+    shell_state.bg_jobs++;
+    return 0;
+}
+
+static int run_compound(const Command *cmd) {
+    switch (cmd->kind) {
+    case CMD_IF:      return run_if(cmd->compound);
+    case CMD_WHILE:   return run_loop(cmd->compound, false);
+    case CMD_UNTIL:   return run_loop(cmd->compound, true);
+    case CMD_FOR:     return run_for(cmd->compound);
+    case CMD_CASE:    return run_case(cmd->compound);
+    case CMD_FUNCDEF: define_function(cmd->compound); return 0;
+    case CMD_GROUP:
+    case CMD_SUBSHELL: return execute_list(&cmd->compound->body);
+    case CMD_COPROC:  return run_coproc(cmd->compound);
+    default:          return 0;
+    }
+}
+
+/* ---------- Child side ---------- */
+
+// In a child: apply prefix assignments, then exec with the cached environment
+static void exec_external(const Command *cmd, char **argv) {
+    apply_assigns(cmd->assigns, true);
+    environ = vars_envp();
+
+    // Execute program (search PATH, inherit environment)
+    execvp(argv[0], argv);
+
+    // if execvp returns, it failed
+    perror("execvp");
+    _exit(127); // 127 is conventional command not found/exec failed
+}
+
+/* Run any kind of command inside an already-forked child and exit.
+ * argv may be pre-expanded by the parent, or NULL to expand here.
+ */
+static void run_in_child(const Command *cmd, char **argv) {
+    apply_redirections(cmd);
+
+    int status = 0;
+    if (cmd->kind == CMD_GROUP || cmd->kind == CMD_SUBSHELL) {
+        // this process is the group's: its last command needs no fork
+        status = run_list(&cmd->compound->body, true);
+    } else if (cmd->kind != CMD_SIMPLE) {
+        status = run_compound(cmd);
+    } else {
+        if (!argv) {
+            // not expanded by a parent (tail of a list): prefixes are ours
+            argv = expand_words(cmd->argv);
+            Prefixes px;
+            int skip = parse_prefixes(argv, &px, false, false);
+            if (skip < 0) _exit(125);
+            apply_prefixes(&px);
+            argv += skip;
         }
+        if (!argv[0]) _exit(0);
 
-        if (cmd->output_file) {
-            int fd = open(cmd->output_file,
-                O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd < 0) {
-                perror(cmd->output_file);
-                _exit(1);
-            }
-            dup2(fd, STDOUT_FILENO);
-            close(fd);
+        const Compound *fn = find_function(argv[0]);
+        if (fn) {
+            apply_assigns(cmd->assigns, false);
+            status = call_function(fn, argv);
+        } else if (is_builtin(argv[0])) {
+            apply_assigns(cmd->assigns, false);
+            status = run_builtin(argv);
+        } else if (strcmp(argv[0], "cat") == 0 && fastcat_supported(argv)) {
+            // pipeline stage or background cat: still no exec
+            status = fastcat_run(argv);
+        } else {
+            exec_external(cmd, argv);
+        }
+    }
+    fflush(stdout);
+    _exit(status);
+}
+
+// `cat FILE... [redirections]` copied by the shell itself: no fork or exec
+static int run_fastcat_in_shell(const Command *cmd, char **argv) {
+    SavedFd saved[2 * cmd->num_redirs + 1];
+    size_t n = 0;
+    int status = redirect_in_shell(cmd, saved, &n) < 0 ? 1 : fastcat_run(argv);
+    restore_fds(saved, n);
+    return status;
+}
+
+/* ---------- Core: run a single command ---------- */
+static int run_single_command(const Command *cmd, int background) {
+    if (!cmd) {
+        // Empty command - nothing to do
+        return 0;
+    }
+
+    char **argv = NULL;
+    int skip = 0;           // prefix words before the command
+    Prefixes px;
+    if (cmd->kind == CMD_SIMPLE) {
+        // Expand variables and any * or ? in arguments
+        cmdsub_take_status();
+        uint64_t t = cap_now();
+        argv = expand_words(cmd->argv);
+        cap_add(CAP_EXPAND, t);
+        if (!argv[0]) {
+            // only NAME=value words: set shell variables
+            apply_assigns(cmd->assigns, false);
+            free_words(argv);
+            // status is that of the last $(...) in them, if any
+            int status = cmdsub_take_status();
+            return status < 0 ? 0 : status;
         }
 
-        if (cmd->error_file) {
-            int fd = open(cmd->error_file,
-                O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd < 0) {
-                perror(cmd->error_file);
-                _exit(1);
-            }
-            dup2(fd, STDERR_FILENO);
-            close(fd);
+        // prefixed commands need a child to apply them to
+        skip = parse_prefixes(argv, &px, true, false);
+        if (skip < 0) {
+            free_words(argv);
+            return 125;
         }
 
+        // Functions and builtins run in the shell itself (no fork),
+        // with any redirections applied around them
+        const Compound *fn = skip ? NULL : find_function(argv[0]);
+        if (!skip && (fn || is_builtin(argv[0])) &&
+            (!has_redirections(cmd) || (!background && !has_multios(cmd)))) {
+            SavedFd fds[2 * cmd->num_redirs + 1];
+            size_t n = 0;
+            int status = 1;
+            if (redirect_in_shell(cmd, fds, &n) == 0) {
+                char **saved = save_assigns(cmd->assigns);
+                apply_assigns(cmd->assigns, false);
+                status = fn ? call_function(fn, argv) : run_builtin(argv);
+                restore_assigns(saved);
+            }
+            restore_fds(fds, n);
+            free_words(argv);
+            return status;
+        }
+        if (!skip && !fn && !background && strcmp(argv[0], "cat") == 0 &&
+            fastcat_supported(argv) && !has_multios(cmd)) {
+            int status = run_fastcat_in_shell(cmd, argv);
+            free_words(argv);
+            return status;
+        }
+    } else if (cmd->argv) {
+        // `timeout 5 ( a | b )`: the compound runs in a child that the
+        // prefixes apply to, like a simple command's
+        argv = expand_words(cmd->argv);
+        skip = parse_prefixes(argv, &px, true, true);
+        if (skip < 0) {
+            free_words(argv);
+            return 125;
+        }
+    } else if (cmd->kind == CMD_FUNCDEF || cmd->kind == CMD_COPROC) {
+        return run_compound(cmd);
+    } else if (cmd->kind != CMD_SUBSHELL && !background && !has_multios(cmd)) {
+        // Compound command in the current shell; for `{ ...; } > file`
+        // or `while ...; done < file` the shell itself is redirected
+        // around the body, so its assignments and cd's stay
+        if (!has_redirections(cmd)) return run_compound(cmd);
+        SavedFd saved[2 * cmd->num_redirs + 1];
+        size_t n = 0;
+        int status = redirect_in_shell(cmd, saved, &n) < 0 ? 1 : run_compound(cmd);
+        restore_fds(saved, n);
+        return status;
+    }
 
-        // Execute program (search PATH, inherit environment)
-        execvp(cmd->argv[0], cmd->argv);
+    // Fork a child to run external program (or a redirected compound)
+    bool terminal = skip && px.timed && !background && owns_terminal();
+    fflush(stdout);
+    uint64_t t = cap_now();
+    pid_t pid = fork();
+    cap_add(CAP_SPAWN, t);
+    if (pid < 0) {
+        perror("fork");
+        free_words(argv);
+        return 1;
+    }
 
-        // if execvp returns, it failed
-        perror("execvp");
-        _exit(127); // 127 is conventional command not found/exec failed
+    if (pid == 0) {
+        /* ---------- Child process ---------- */
+        reset_child_signals();
+        if (skip) apply_prefixes(&px);
+        if (terminal) set_terminal(getpid());
+        run_in_child(cmd, skip ? argv + skip : argv);
     }
 
     /* ---------- Parent (shell) ---------- */
+    free_words(argv);
+    if (skip && px.timed) {
+        setpgid(pid, pid);
+        if (terminal) set_terminal(pid);
+        deadline_add(pid, &px.deadline);
+    }
     if (background) {
         // don't wait, print PID to show background job
         printf("[background pid %d]\n", (int)pid);
+        shell_state.bg_jobs++;
         fflush(stdout);
         return 0;
     }
 
     // Foreground: wait for the child to finish
-    int status = 0;
-    for (;;) {
-        pid_t w = waitpid(pid, &status, 0);
-        if (w < 0) {
-            if (errno == EINTR) continue;
-            perror("waitpid");
-            return -1;
-        }
+    int status = wait_foreground(pid);
+    if (terminal) set_terminal(getpgrp());
+    return status;
+}
 
-        // If child was terminated by signal, print newline
-        if (WIFSIGNALED(status)) {
-            write(STDOUT_FILENO, "\n", 1);
-        }
+/* ---------- Pipelines ---------- */
 
-        break;
+// Apply `set -o pipebuf` to a new pipe (F_SETPIPE_SZ is Linux-only)
+static void size_pipe(int fd) {
+#ifdef F_SETPIPE_SZ
+    if (shell_state.pipe_buf > 0) {
+        fcntl(fd, F_SETPIPE_SZ, (int)shell_state.pipe_buf);
     }
+#else
+    (void)fd;
+#endif
+}
 
-    return 0;
+#ifdef __linux__
+/* `set -o pipepin`: CPUs the shell may use, ordered by package and core
+ * so neighbouring entries are SMT siblings or cores sharing a cache.
+ * Stage i of a pipeline runs on entry (base + i), so adjacent stages
+ * sit next to each other and hand data over through a warm cache.
+ */
+typedef struct {
+    int cpu;
+    int package;
+    int core;
+} CpuSlot;
+
+static CpuSlot *pin_order = NULL;
+static size_t pin_count = 0;
+static size_t pin_next = 0;     // base for the next pipeline
 
+static int read_topology(int cpu, const char *what, int def) {
+    char path[96];
+    snprintf(path, sizeof path,
+        "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, what);
+    FILE *f = fopen(path, "r");
+    if (!f) return def;
+    int v = def;
+    if (fscanf(f, "%d", &v) != 1) v = def;
+    fclose(f);
+    return v;
 }
 
-/* ---------- Public entry point ---------- */
-int execute_job(const Job *job) {
-    if (job->num_cmds > 1) {
-        size_t num_pipes = job->num_cmds > 0 ? job->num_cmds - 1 : 0;
-        int pipes[num_pipes][2];
-
-        // create pipes
-        for (size_t i = 0; i < num_pipes; i++) {
-            if (pipe(pipes[i]) < 0) {
-                perror("pipe");
-                return -1;
-            }
+static int cmp_cpu_slot(const void *a, const void *b) {
+    const CpuSlot *x = a, *y = b;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static void build_pin_order(void) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof set, &set) < 0) return;
+
+    pin_order = calloc((size_t)CPU_COUNT(&set), sizeof *pin_order);
+    if (!pin_order) return;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET((size_t)cpu, &set)) continue;
+        CpuSlot *s = &pin_order[pin_count++];
+        s->cpu = cpu;
+        s->package = read_topology(cpu, "physical_package_id", 0);
+        s->core = read_topology(cpu, "core_id", cpu);
+    }
+    qsort(pin_order, pin_count, sizeof *pin_order, cmp_cpu_slot);
+}
+
+// In a pipeline child: pin this stage next to its neighbours
+static void pin_stage(size_t base, size_t stage) {
+    if (pin_count == 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET((size_t)pin_order[(base + stage) % pin_count].cpu, &set);
+    sched_setaffinity(0, sizeof set, &set);
+}
+#endif
+
+/* A pipeline that could not be started: close the pipe ends the shell
+ * still holds (closed ones are -1) and stop and reap the stages that
+ * are already running, so neither fds nor zombies are left behind.
+ */
+static int abandon_pipeline(int (*pipes)[2], size_t num_pipes, const pid_t *pids,
+                            size_t started) {
+    procsub_set_pipeline(NULL, 0);
+    for (size_t i = 0; i < num_pipes; i++) {
+        if (pipes[i][0] >= 0) close(pipes[i][0]);
+        if (pipes[i][1] >= 0) close(pipes[i][1]);
+    }
+    for (size_t i = 0; i < started; i++) kill(pids[i], SIGTERM);
+    for (size_t i = 0; i < started; i++) {
+        int status;
+        DeadlineOutcome timed;
+        deadline_waitpid(pids[i], &status, &timed);
+    }
+    return 1;
+}
+
+static int run_pipeline(const Job *job) {
+    size_t num_pipes = job->num_cmds > 0 ? job->num_cmds - 1 : 0;
+    int pipes[num_pipes + 1][2];
+    pid_t pids[job->num_cmds];
+    for (size_t i = 0; i < num_pipes; i++) pipes[i][0] = pipes[i][1] = -1;
+
+    // create pipes
+    for (size_t i = 0; i < num_pipes; i++) {
+        if (pipe(pipes[i]) < 0) {
+            perror("pipe");
+            return abandon_pipeline(pipes, num_pipes, pids, 0);
         }
+        size_pipe(pipes[i][1]);
+    }
+
+#ifdef __linux__
+    size_t pin_base = 0;
+    if (shell_state.pipe_pin) {
+        if (!pin_order) build_pin_order();
+        pin_base = pin_next;
+        pin_next += job->num_cmds;
+    }
+#endif
+
+    fflush(stdout);
+    procsub_set_pipeline(pipes, num_pipes);     // helpers must not hold them
+
+    for (size_t i =0; i < job->num_cmds; i++) {
+        const Command *cmd = &job->commands[i];
 
-        pid_t pids[job->num_cmds];
+        // expand in the shell, so process substitution helpers
+        // are its own children and are reaped with this job
+        size_t stage_mark = procsub_mark();
+        uint64_t t = cap_now();
+        char **argv = cmd->argv ? expand_words(cmd->argv) : NULL;
+        cap_add(CAP_EXPAND, t);
+        Prefixes px;
+        int skip = argv ? parse_prefixes(argv, &px, true, cmd->kind != CMD_SIMPLE) : 0;
+
+        t = cap_now();
+        pid_t pid = fork();
+        cap_add(CAP_SPAWN, t);
+        if (pid < 0) {
+            perror("fork");
+            free_words(argv);
+            procsub_close_fds(stage_mark);
+            return abandon_pipeline(pipes, num_pipes, pids, i);
+        }
 
-        for (size_t i =0; i < job->num_cmds; i++) {
-            Command *cmd = &job->commands[i];
-            expand_wildcards(cmd);
+        if (pid == 0) {
+            /* ---------- child ---------- */
+            reset_child_signals();
+#ifdef __linux__
+            if (shell_state.pipe_pin) pin_stage(pin_base, i);
+#endif
 
-            pid_t pid = fork();
-            if (pid < 0) {
-                perror("fork");
-                return -1;
+            // connect input
+            if (i > 0) {
+                dup2(pipes[i-1][0], STDIN_FILENO);
+            }
+            // connect output
+            if (i < num_pipes) {
+                dup2(pipes[i][1], STDOUT_FILENO);
+                stdout_piped = true;
             }
 
-            if (pid == 0) {
-                /* ---------- child ---------- */
-                signal(SIGINT, SIG_DFL);
-                signal(SIGQUIT, SIG_DFL);
-                signal(SIGTSTP, SIG_DFL);
-
-                // connect input
-                if (i > 0) {
-                    dup2(pipes[i-1][0], STDIN_FILENO);
-                }
-                // connect output
-                if (i < num_pipes) {
-                    dup2(pipes[i][1], STDOUT_FILENO);
-                }
-                
-                // close all pipe ends
-                for (size_t j = 0; j < num_pipes; j++) {
-                    close(pipes[j][0]);
-                    close(pipes[j][1]);   
-                }
-
-                // apply redirections
-                if (cmd->input_file) {
-                    int fd = open(cmd->input_file, O_RDONLY);
-                    if (fd < 0) {
-                        perror(cmd->input_file);
-                        _exit(1);
-                    }
-                    dup2(fd, STDIN_FILENO);
-                    close(fd);
-                }
-                if (cmd->output_file) {
-                    int fd = open(cmd->output_file,
-                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                    if (fd < 0) {
-                        perror(cmd->output_file);
-                        _exit(1);
-                    }
-                    dup2(fd, STDOUT_FILENO);
-                    close(fd);
-                }
-                if (cmd->error_file) {
-                    int fd = open(cmd->error_file, 
-                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                    if (fd < 0) {
-                        perror(cmd->error_file);
-                        _exit(1);
-                    }
-                    dup2(fd, STDERR_FILENO);
-                    close(fd);
-                }
-
-                execvp(cmd->argv[0], cmd->argv);
-                perror("execvp");
-                _exit(127);
+            // close all pipe ends
+            for (size_t j = 0; j < num_pipes; j++) {
+                if (pipes[j][0] >= 0) close(pipes[j][0]);
+                if (pipes[j][1] >= 0) close(pipes[j][1]);
             }
 
-            /* ---------- parent ---------- */
-            pids[i] = pid;
+            // apply redirections and run the stage
+            if (skip < 0) _exit(125);
+            if (skip) apply_prefixes(&px);
+            run_in_child(cmd, skip ? argv + skip : argv);
+        }
 
-            // close ends not needed in parent
-            if (i > 0) close(pipes[i-1][0]);
-            if (i < num_pipes) close(pipes[i][1]);
+        /* ---------- parent ---------- */
+        pids[i] = pid;
+        free_words(argv);
+        if (skip > 0 && px.timed) {
+            // a timed stage: only it (and its children) get the signal
+            setpgid(pid, pid);
+            deadline_add(pid, &px.deadline);
         }
+        procsub_close_fds(stage_mark); // the stage holds them now
 
-        // parent closes any remaining pipe read ends
-        if (num_pipes > 0) close(pipes[num_pipes-1][0]);
+        // close ends not needed in parent
+        if (i > 0) {
+            close(pipes[i-1][0]);
+            pipes[i-1][0] = -1;
+        }
+        if (i < num_pipes) {
+            close(pipes[i][1]);
+            pipes[i][1] = -1;
+        }
+    }
+    procsub_set_pipeline(NULL, 0);
 
-        // wait unless background
-        if (!job->background) {
-            for (size_t i = 0; i < job->num_cmds; i++) {
-                int status;
-                waitpid(pids[i], &status, 0);
-            }
-        } else {
-            printf("[background pipeline started]\n");
+    // wait unless background; the pipeline's status is the last stage's
+    int last = 0;
+    if (!job->background) {
+        uint64_t t = cap_now();
+        for (size_t i = 0; i < job->num_cmds; i++) {
+            int status = 0;
+            DeadlineOutcome timed;
+            deadline_waitpid(pids[i], &status, &timed);
+            if (i == job->num_cmds - 1) last = status_from_deadline(status, timed);
         }
+        cap_add(CAP_WAIT, t);
+    } else {
+        printf("[background pipeline started]\n");
+        shell_state.bg_jobs += job->num_cmds;
+    }
 
-        return 0;
+    return last;
+}
+
+/* ---------- Public entry points ---------- */
+int execute_job(const Job *job) {
+    size_t mark = procsub_mark();
+    int status;
+    if (job->num_cmds > 1) {
+        status = run_pipeline(job);
+    } else {
+        // Single command job
+        status = run_single_command(&job->commands[0], job->background);
+    }
+    // process substitutions end with their job
+    procsub_finish(mark, !job->background);
+    return status;
+}
+
+int execute_string(const char *text) {
+    JobList list = parse_line(text);
+    int status = list.error || list.incomplete ? 2 : execute_list(&list);
+    free_job_list(&list);
+    return status;
+}
+
+bool execute_capture(const char *text, char **out, size_t *len, int *status) {
+    JobList list = parse_line(text);
+    const Job *job = list.count == 1 ? list.jobs[0] : NULL;
+    const Command *cmd = job && job->num_cmds == 1 ? &job->commands[0] : NULL;
+
+    // the name is checked unexpanded so nothing runs twice on fallback
+    if (list.error || list.incomplete || !cmd || job->background ||
+        cmd->kind != CMD_SIMPLE || cmd->assigns || has_redirections(cmd) ||
+        !cmd->argv || !cmd->argv[0] || !is_capture_builtin(cmd->argv) ||
+        find_function(cmd->argv[0])) {
+        free_job_list(&list);
+        return false;
+    }
+
+    fflush(stdout);
+    FILE *mem = open_memstream(out, len);
+    if (!mem) {
+        free_job_list(&list);
+        return false;
+    }
+    char **argv = expand_words(cmd->argv);
+    FILE *saved = stdout;
+    stdout = mem;
+    *status = argv[0] ? run_builtin(argv) : 0;
+    stdout = saved;
+    fclose(mem);
 
+    free_words(argv);
+    free_job_list(&list);
+    return true;
+}
+
+/* With tail set the process exits after the list, so a lone last
+ * command takes it over (run_in_child execs or runs it, then exits)
+ * instead of forking a child to wait for.
+ */
+static int run_list(const JobList *list, bool tail) {
+    int status = 0;
+    bool run = true;
+    for (size_t i = 0; i < list->count; i++) {
+        const Job *job = list->jobs[i];
+        if (!job || job->num_cmds == 0) continue;
+
+        const Command *last = &job->commands[0];
+        if (run && tail && i == list->count - 1 && job->num_cmds == 1 &&
+            !job->background &&
+            !(last->kind == CMD_SIMPLE && last->argv[0] &&
+              strcmp(last->argv[0], "timeout") == 0) &&     // needs a waiting shell
+            !(last->kind != CMD_SIMPLE && last->argv)) {    // prefixed compound, likewise
+            fflush(stdout);
+            run_in_child(last, NULL);
+        }
+        if (run) {
+            status = execute_job(job);
+            shell_state.last_status = status;
+        }
+        if (flow_pending()) break;
+
+        // && and || decide whether the next job runs
+        if (job->and_if) run = (status == 0);
+        else if (job->or_if) run = (status != 0);
+        else run = true;
     }
+    return status;
+}
 
-    // Single command job
-    return run_single_command(&job->commands[0], job->background);
+int execute_list(const JobList *list) {
+    return run_list(list, false);
 }
 
+int execute_list_exec(const JobList *list) {
+    return run_list(list, true);
+}
@@ -2,6 +2,31 @@
 #define EXECUTOR_H
 #include "shelltypes.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+
 int execute_job(const Job *job);
 
+// Run a list of jobs honouring && and ||; returns the last exit status
+int execute_list(const JobList *list);
+
+/* Like execute_list, in a process that exits right after it (-c, a
+* subshell): the last command replaces the process when it can, saving
+* a fork. Returns only if it did not.
+*/
+int execute_list_exec(const JobList *list);
+
+// Parse and run a string of shell code (used by substitutions)
+int execute_string(const char *text);
+
+/* Run text in the shell itself with its stdout captured into a new
+* buffer *out of *len bytes, when it is one simple command naming an
+* output-only builtin (pwd, echo, history, ...). Returns false without
+* running anything if it needs a child process.
+*/
+bool execute_capture(const char *text, char **out, size_t *len, int *status);
+
+// true if name runs without a PATH search: builtin, function or prefix
+bool executor_has_command(const char *name);
+
 #endif
@@ -0,0 +1,577 @@
+#include "expand.h"
+#include "vars.h"
+#include "builtins.h"
+#include "executor.h"
+#include "coproc.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <glob.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+extern ShellState shell_state;
+
+/* ---------- Growable string ---------- */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} Buf;
+
+static void buf_push(Buf *b, char c) {
+    if (b->len + 2 > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 32;
+        char *tmp = realloc(b->buf, cap);
+        if (!tmp) return;
+        b->buf = tmp;
+        b->cap = cap;
+    }
+    b->buf[b->len++] = c;
+    b->buf[b->len] = '\0';
+}
+
+static char *buf_take(Buf *b) {
+    char *s = b->buf ? b->buf : strdup("");
+    b->buf = NULL;
+    b->len = b->cap = 0;
+    return s;
+}
+
+typedef struct {
+    char **data;
+    size_t size;
+    size_t cap;
+} WordVec;
+
+static void wv_push(WordVec *v, char *s) {
+    if (v->size + 2 > v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 8;
+        char **tmp = realloc(v->data, cap * sizeof *tmp);
+        if (!tmp) { free(s); return; }
+        v->data = tmp;
+        v->cap = cap;
+    }
+    v->data[v->size++] = s;
+    v->data[v->size] = NULL;
+}
+
+void free_words(char **words) {
+    if (!words) return;
+    for (size_t i = 0; words[i]; i++) free(words[i]);
+    free(words);
+}
+
+/* ---------- Parameters ---------- */
+
+static int is_digits(const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (!isdigit((unsigned char)s[i])) return 0;
+    }
+    return n > 0;
+}
+
+// NAME[N]: an element of an array (only coprocesses have them)
+static int is_element(const char *s, size_t n) {
+    const char *open = memchr(s, '[', n);
+    return open && s[n - 1] == ']' && var_valid_name(s, (size_t)(open - s)) &&
+           is_digits(open + 1, (size_t)(s + n - 1 - (open + 1)));
+}
+
+/* Parse a parameter reference just after '$'.
+* Returns number of bytes consumed (0 if not a parameter).
+*/
+static size_t parse_param(const char *p, const char **name, size_t *len) {
+    if (*p == '{') {
+        const char *end = strchr(p + 1, '}');
+        if (!end) return 0;
+        size_t n = (size_t)(end - (p + 1));
+        if (n == 1 && strchr("?$#@*", p[1])) {
+            *name = p + 1;
+        } else if (var_valid_name(p + 1, n) || is_digits(p + 1, n) || is_element(p + 1, n)) {
+            *name = p + 1;
+        } else {
+            return 0;
+        }
+        *len = n;
+        return n + 2;
+    }
+    if (*p && strchr("?$#@*0123456789", *p)) {
+        *name = p;
+        *len = 1;
+        return 1;
+    }
+    if (isalpha((unsigned char)*p) || *p == '_') {
+        size_t n = 1;
+        while (isalnum((unsigned char)p[n]) || p[n] == '_') n++;
+        *name = p;
+        *len = n;
+        return n;
+    }
+    return 0;
+}
+
+static const char *param_value(const char *name, size_t len, char *numbuf, size_t numsz) {
+    if (len == 1 && name[0] == '?') {
+        snprintf(numbuf, numsz, "%d", shell_state.last_status);
+        return numbuf;
+    }
+    if (len == 1 && name[0] == '$') {
+        snprintf(numbuf, numsz, "%d", (int)shell_state.shell_pid);
+        return numbuf;
+    }
+    if (len == 1 && name[0] == '#') {
+        snprintf(numbuf, numsz, "%zu", shell_state.num_params);
+        return numbuf;
+    }
+    if (len == 1 && name[0] == '0') return "myshell";
+    if (is_digits(name, len)) {
+        size_t n = (size_t)strtoul(name, NULL, 10);
+        return n >= 1 && n <= shell_state.num_params ? shell_state.params[n - 1] : NULL;
+    }
+
+    const char *open = memchr(name, '[', len);
+    if (open) {
+        return coproc_element(name, (size_t)(open - name), strtoul(open + 1, NULL, 10));
+    }
+
+    char tmp[256];
+    if (len >= sizeof tmp) return NULL;
+    memcpy(tmp, name, len);
+    tmp[len] = '\0';
+    return var_get(tmp);
+}
+
+/* ---------- Process substitution ---------- */
+typedef struct {
+    pid_t pid;
+    int fd;         // shell's end of the pipe, -1 once closed
+} ProcSub;
+
+static ProcSub *procsubs = NULL;
+static size_t num_procsubs = 0;
+static pid_t *bg_helpers = NULL;        // helpers of background jobs, not yet reaped
+static size_t num_bg_helpers = 0;
+static int (*pipeline_fds)[2] = NULL;    // pipe ends of the pipeline being started
+static size_t num_pipeline_fds = 0;
+
+size_t procsub_mark(void) {
+    return num_procsubs;
+}
+
+void procsub_close_fds(size_t mark) {
+    for (size_t i = mark; i < num_procsubs; i++) {
+        if (procsubs[i].fd >= 0) {
+            close(procsubs[i].fd);
+            procsubs[i].fd = -1;
+        }
+    }
+}
+
+void procsub_finish(size_t mark, int wait) {
+    procsub_close_fds(mark);
+    for (size_t i = mark; i < num_procsubs; i++) {
+        if (wait) {
+            while (waitpid(procsubs[i].pid, NULL, 0) < 0 && errno == EINTR) {}
+            continue;
+        }
+        // the job runs on: reaped when it ends, without being a job itself
+        pid_t *tmp = realloc(bg_helpers, (num_bg_helpers + 1) * sizeof *tmp);
+        if (!tmp) continue;
+        bg_helpers = tmp;
+        bg_helpers[num_bg_helpers++] = procsubs[i].pid;
+    }
+    if (mark < num_procsubs) num_procsubs = mark;
+}
+
+bool procsub_reaped(pid_t pid) {
+    for (size_t i = 0; i < num_bg_helpers; i++) {
+        if (bg_helpers[i] == pid) {
+            bg_helpers[i] = bg_helpers[--num_bg_helpers];
+            return true;
+        }
+    }
+    return false;
+}
+
+void procsub_set_pipeline(int (*pipes)[2], size_t n) {
+    pipeline_fds = pipes;
+    num_pipeline_fds = pipes ? n : 0;
+}
+
+/* Start `text` in a child connected by a pipe. For <(list) the child
+ * writes to the pipe, for >(list) it reads from it. Returns the
+ * shell's end of the pipe, or -1.
+ */
+static int procsub_start(const char *text, size_t len, int input) {
+    int pfd[2];
+    if (pipe(pfd) < 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(pfd[0]);
+        close(pfd[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        /* ---------- helper child ---------- */
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+
+        // don't hold other substitutions' pipes, or the pipeline's, open
+        procsub_close_fds(0);
+        num_procsubs = 0;
+        num_bg_helpers = 0;
+        for (size_t i = 0; i < num_pipeline_fds; i++) {
+            if (pipeline_fds[i][0] >= 0) close(pipeline_fds[i][0]);
+            if (pipeline_fds[i][1] >= 0) close(pipeline_fds[i][1]);
+        }
+        procsub_set_pipeline(NULL, 0);
+
+        dup2(input ? pfd[1] : pfd[0], input ? STDOUT_FILENO : STDIN_FILENO);
+        close(pfd[0]);
+        close(pfd[1]);
+
+        char *cmd = strndup(text, len);
+        int status = execute_string(cmd);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    /* ---------- parent ---------- */
+    int keep = input ? pfd[0] : pfd[1];
+    close(input ? pfd[1] : pfd[0]);
+
+    ProcSub *tmp = realloc(procsubs, (num_procsubs + 1) * sizeof *tmp);
+    if (tmp) {
+        procsubs = tmp;
+        procsubs[num_procsubs].pid = pid;
+        procsubs[num_procsubs].fd = keep;
+        num_procsubs++;
+    }
+    return keep;
+}
+
+/* ---------- Command substitution ---------- */
+#define CMDSUB_READ_MIN 65536   // first read size; the buffer doubles after
+
+static int cmdsub_status = -1;
+
+int cmdsub_take_status(void) {
+    int s = cmdsub_status;
+    cmdsub_status = -1;
+    return s;
+}
+
+/* Run text in a child and read all of its stdout into one growing
+ * buffer. Returns the buffer (length in *len) or NULL.
+ */
+static char *cmdsub_read(const char *text, size_t *len, int *status) {
+    int pfd[2];
+    if (pipe(pfd) < 0) {
+        perror("pipe");
+        return NULL;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(pfd[0]);
+        close(pfd[1]);
+        return NULL;
+    }
+
+    if (pid == 0) {
+        /* ---------- substitution child ---------- */
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        procsub_close_fds(0);
+        num_procsubs = 0;
+
+        dup2(pfd[1], STDOUT_FILENO);
+        close(pfd[0]);
+        close(pfd[1]);
+        int st = execute_string(text);
+        fflush(stdout);
+        _exit(st);
+    }
+
+    /* ---------- parent ---------- */
+    close(pfd[1]);
+    char *buf = NULL;
+    size_t used = 0, cap = 0;
+    for (;;) {
+        if (cap - used < CMDSUB_READ_MIN / 2) {
+            size_t ncap = cap ? cap * 2 : CMDSUB_READ_MIN;
+            char *tmp = realloc(buf, ncap);
+            if (!tmp) break;
+            buf = tmp;
+            cap = ncap;
+        }
+        ssize_t n = read(pfd[0], buf + used, cap - used - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        used += (size_t)n;
+    }
+    close(pfd[0]);
+
+    int wst = 0;
+    while (waitpid(pid, &wst, 0) < 0 && errno == EINTR) {}
+    if (WIFEXITED(wst)) *status = WEXITSTATUS(wst);
+    else if (WIFSIGNALED(wst)) *status = 128 + WTERMSIG(wst);
+    else *status = 1;
+
+    *len = used;
+    return buf;
+}
+
+/* Output of $(list): output-only builtins run in the shell itself,
+ * anything else in a child. Trailing newlines are dropped. Returns a
+ * malloc'ed string (never NULL).
+ */
+static char *cmdsub_output(const char *text, size_t textlen) {
+    char *cmd = strndup(text, textlen);
+    char *out = NULL;
+    size_t len = 0;
+    int status = 0;
+    if (!execute_capture(cmd, &out, &len, &status)) {
+        out = cmdsub_read(cmd, &len, &status);
+    }
+    free(cmd);
+
+    if (!out) return strdup("");
+    while (len > 0 && out[len - 1] == '\n') len--;
+    out[len] = '\0';      // both paths leave room for the terminator
+
+    shell_state.last_status = status;
+    cmdsub_status = status;
+    return out;
+}
+
+/* ---------- Field builder ---------- */
+typedef struct {
+    Buf lit;        // text with markers removed
+    Buf pat;        // glob pattern (quoted chars backslash-escaped)
+    int has_glob;   // unquoted * or ? present
+    int started;    // field exists even if empty ("" or "$EMPTY")
+} Field;
+
+enum {
+    EXP_FIELDS,     // split and glob into fields
+    EXP_WORD,       // one word, no splitting or globbing
+    EXP_PATTERN     // one word as an fnmatch pattern
+};
+
+static void field_literal(Field *f, char c) {
+    buf_push(&f->lit, c);
+    if (strchr("*?[\\", c)) buf_push(&f->pat, '\\');
+    buf_push(&f->pat, c);
+    f->started = 1;
+}
+
+static void field_active(Field *f, char c) {
+    buf_push(&f->lit, c);
+    if (c == '*' || c == '?') f->has_glob = 1;
+    if (c == '\\') buf_push(&f->pat, '\\');
+    buf_push(&f->pat, c);
+    f->started = 1;
+}
+
+static void field_finish(Field *f, WordVec *out, int mode) {
+    if (mode == EXP_PATTERN) {
+        wv_push(out, buf_take(&f->pat));
+        free(f->lit.buf);
+        memset(f, 0, sizeof *f);
+        return;
+    }
+    if (f->started) {
+        glob_t g;
+        memset(&g, 0, sizeof g);
+        if (mode == EXP_FIELDS && f->has_glob && f->pat.buf &&
+            glob(f->pat.buf, 0, NULL, &g) == 0 && g.gl_pathc > 0) {
+            for (size_t j = 0; j < g.gl_pathc; j++) {
+                wv_push(out, strdup(g.gl_pathv[j]));
+            }
+            globfree(&g);
+            free(f->lit.buf);
+        } else {
+            // no matches: keep the original token
+            wv_push(out, buf_take(&f->lit));
+        }
+    } else {
+        free(f->lit.buf);
+    }
+    free(f->pat.buf);
+    memset(f, 0, sizeof *f);
+}
+
+// Append an unquoted expansion: split on blanks, chars stay glob-active
+static void field_split_value(Field *f, WordVec *out, const char *val) {
+    for (const char *v = val; *v; v++) {
+        if (*v == ' ' || *v == '\t' || *v == '\n') {
+            field_finish(f, out, EXP_FIELDS);
+            continue;
+        }
+        field_active(f, *v);
+    }
+}
+
+// "$@": each positional parameter becomes its own field
+static void field_quoted_params(Field *f, WordVec *out, int mode) {
+    for (size_t i = 0; i < shell_state.num_params; i++) {
+        if (i > 0) {
+            if (mode == EXP_FIELDS) field_finish(f, out, mode);
+            else field_literal(f, ' ');
+        }
+        f->started = 1;
+        for (const char *v = shell_state.params[i]; *v; v++) field_literal(f, *v);
+    }
+}
+
+/* Expand one marked word into zero or more fields */
+static void expand_one(const char *w, WordVec *out, int mode) {
+    Field f;
+    memset(&f, 0, sizeof f);
+    char numbuf[32];
+
+    for (const char *p = w; *p; ) {
+        if (*p == CTL_ESC) {
+            if (p[1]) field_literal(&f, p[1]);
+            else f.started = 1;
+            p += p[1] ? 2 : 1;
+            continue;
+        }
+
+        if (*p == CTL_PROCSUB_IN || *p == CTL_PROCSUB_OUT) {
+            // <(list) / >(list): replaced by the /dev/fd path of its pipe
+            const char *end = strchr(p + 1, CTL_END);
+            size_t len = end ? (size_t)(end - (p + 1)) : strlen(p + 1);
+            int fd = procsub_start(p + 1, len, *p == CTL_PROCSUB_IN);
+            if (fd >= 0) {
+                char path[32];
+                snprintf(path, sizeof path, "/dev/fd/%d", fd);
+                for (const char *v = path; *v; v++) field_literal(&f, *v);
+            }
+            p = end ? end + 1 : p + 1 + len;
+            continue;
+        }
+
+        int quoted = 0;
+        if (*p == CTL_QUOTED) {
+            quoted = 1;
+            p++;
+            if (*p != '$' && *p != CTL_CMDSUB) continue;
+        }
+
+        if (*p == CTL_CMDSUB) {
+            const char *end = strchr(p + 1, CTL_END);
+            size_t len = end ? (size_t)(end - (p + 1)) : strlen(p + 1);
+            char *val = cmdsub_output(p + 1, len);
+            if (quoted || mode != EXP_FIELDS) {
+                if (quoted) f.started = 1;
+                for (const char *v = val; *v; v++) field_literal(&f, *v);
+            } else {
+                field_split_value(&f, out, val);
+            }
+            free(val);
+            p = end ? end + 1 : p + 1 + len;
+            continue;
+        }
+
+        if (*p == '$') {
+            const char *name;
+            size_t len;
+            size_t used = parse_param(p + 1, &name, &len);
+            if (used == 0) {
+                // lone '$' is literal
+                field_literal(&f, '$');
+                p++;
+                continue;
+            }
+            p += 1 + used;
+
+            if (len == 1 && (name[0] == '@' || name[0] == '*')) {
+                if (quoted && name[0] == '@') {
+                    field_quoted_params(&f, out, mode);
+                    continue;
+                }
+                // $* and unquoted $@ join the parameters with spaces
+                for (size_t i = 0; i < shell_state.num_params; i++) {
+                    if (i > 0) {
+                        if (quoted || mode != EXP_FIELDS) field_literal(&f, ' ');
+                        else field_finish(&f, out, mode);
+                    }
+                    const char *v = shell_state.params[i];
+                    if (quoted || mode != EXP_FIELDS) {
+                        for (; *v; v++) field_literal(&f, *v);
+                    } else {
+                        field_split_value(&f, out, v);
+                    }
+                }
+                if (quoted) f.started = 1;
+                continue;
+            }
+
+            if (quoted) f.started = 1;
+            const char *val = param_value(name, len, numbuf, sizeof numbuf);
+            if (!val) continue;
+
+            if (quoted || mode != EXP_FIELDS) {
+                for (const char *v = val; *v; v++) field_literal(&f, *v);
+            } else {
+                field_split_value(&f, out, val);
+            }
+            continue;
+        }
+
+        field_active(&f, *p);
+        p++;
+    }
+    field_finish(&f, out, mode);
+}
+
+char **expand_words(char *const *words) {
+    WordVec out = {0};
+    if (words) {
+        for (size_t i = 0; words[i]; i++) expand_one(words[i], &out, EXP_FIELDS);
+    }
+    if (!out.data) {
+        out.data = calloc(1, sizeof *out.data);
+    }
+    return out.data;
+}
+
+// Expand to exactly one string in the given mode
+static char *expand_single(const char *word, int mode) {
+    WordVec out = {0};
+    expand_one(word, &out, mode);
+    if (out.size == 0) {
+        free(out.data);
+        return strdup("");
+    }
+    char *s = out.data[0];
+    for (size_t i = 1; i < out.size; i++) free(out.data[i]);
+    free(out.data);
+    return s;
+}
+
+char *expand_word_nosplit(const char *word) {
+    return expand_single(word, EXP_WORD);
+}
+
+char *expand_pattern(const char *word) {
+    return expand_single(word, EXP_PATTERN);
+}
@@ -0,0 +1,63 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Word expansion.
+* The tokenizer keeps quoting information inside each word using
+* marker bytes, so expansion can run later (at execution time):
+*   CTL_ESC    - the next byte is literal (quoted or backslash-escaped)
+*   CTL_QUOTED - the following '$' expansion was inside double quotes
+*                (expanded, but not field-split or globbed)
+*   CTL_PROCSUB_IN / CTL_PROCSUB_OUT ... CTL_END
+*              - raw command text of <(list) / >(list)
+*   CTL_CMDSUB ... CTL_END
+*              - raw command text of $(list) / `list` (after CTL_QUOTED
+*                when inside double quotes)
+*/
+#define CTL_ESC         '\001'
+#define CTL_QUOTED      '\002'
+#define CTL_PROCSUB_IN  '\003'
+#define CTL_PROCSUB_OUT '\004'
+#define CTL_END         '\005'
+#define CTL_CMDSUB      '\006'
+
+/* Expand $VAR, ${VAR}, $?, $$, $1.., $#, $@, $* and $(list), split unquoted
+* results on whitespace, glob * and ? patterns, and strip the markers.
+* Returns a new NULL-terminated argv (free with free_words).
+*/
+char **expand_words(char *const *words);
+
+// Expand a single word without field splitting or globbing
+char *expand_word_nosplit(const char *word);
+
+// Expand a word into an fnmatch(3) pattern (quoted chars escaped)
+char *expand_pattern(const char *word);
+
+void free_words(char **words);
+
+/* Process substitution helpers started during expansion.
+* The word becomes /dev/fd/N, with the pipe end left open in the shell
+* so the consumer inherits it. The owning job brackets its expansions
+* with procsub_mark() / procsub_finish().
+*/
+size_t procsub_mark(void);
+// Close the shell's copies of fds opened since mark (consumer has forked)
+void procsub_close_fds(size_t mark);
+// Close remaining fds since mark and reap those helpers if wait is set;
+// otherwise (a background job) they are left for procsub_reaped
+void procsub_finish(size_t mark, int wait);
+// true if pid was a background job's helper (now forgotten)
+bool procsub_reaped(pid_t pid);
+// Pipe ends of the pipeline whose stages are being expanded, which
+// helpers close; NULL when none
+void procsub_set_pipeline(int (*pipes)[2], size_t n);
+
+/* Exit status of the last command substitution run since the previous
+* call, or -1 if there was none (a command of only assignments takes it).
+*/
+int cmdsub_take_status(void);
+
+#endif // EXPAND_H
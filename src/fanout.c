@@ -0,0 +1,202 @@
+#include "fanout.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define FANOUT_CHUNK (1 << 20)  // bytes asked for per tee/splice
+#define RW_BUF_SIZE  65536      // read/write fallback buffer
+
+typedef struct {
+    int fd;                 // -1 once the target stopped taking data
+    bool splice;            // false after splice refused it (O_APPEND)
+} Target;
+
+static char rw_buf[RW_BUF_SIZE];
+
+static void drop(Target *t) {
+    if (t->fd < 0) return;
+    if (errno != EPIPE) perror("multios");
+    close(t->fd);
+    t->fd = -1;
+}
+
+static bool write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        len -= (size_t)w;
+    }
+    return true;
+}
+
+/* Take exactly len bytes out of the pipe `from` and give them to t;
+* once t is gone the bytes are still read, and dropped.
+*/
+static void move(int from, Target *t, size_t len) {
+    while (len > 0) {
+        ssize_t k = -1;
+#ifdef __linux__
+        if (t->fd >= 0 && t->splice) {
+            k = splice(from, NULL, t->fd, NULL, len, SPLICE_F_MOVE);
+            if (k < 0 && errno == EINTR) continue;
+            if (k < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                t->splice = false;
+                continue;
+            }
+            if (k < 0) {
+                drop(t);
+                continue;
+            }
+        }
+#endif
+        if (k < 0) {
+            k = read(from, rw_buf, len < sizeof rw_buf ? len : sizeof rw_buf);
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0) return;
+            if (t->fd >= 0 && !write_all(t->fd, rw_buf, (size_t)k)) drop(t);
+        }
+        len -= (size_t)k;
+    }
+}
+
+/* A tee came up short: read the chunk from `in` once and give each
+* target the part past what it already has (have[i] bytes)
+*/
+static void finish_chunk(int in, Target *targets, const size_t *have, size_t n, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        size_t want = len - off < sizeof rw_buf ? len - off : sizeof rw_buf;
+        ssize_t k = read(in, rw_buf, want);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return;
+        for (size_t i = 0; i < n; i++) {
+            if (targets[i].fd < 0 || off + (size_t)k <= have[i]) continue;
+            size_t skip = have[i] > off ? have[i] - off : 0;
+            if (!write_all(targets[i].fd, rw_buf + skip, (size_t)k - skip)) drop(&targets[i]);
+        }
+        off += (size_t)k;
+    }
+}
+
+// Copy the pipe `in` to every target until all writers are gone
+static void copy_out(int in, Target *targets, size_t n) {
+#ifdef __linux__
+    // one spare pipe, as big as `in`, carries each extra copy
+    int mid[2];
+    if (n > 1 && pipe2(mid, O_CLOEXEC) == 0) {
+        int size = fcntl(in, F_GETPIPE_SZ);
+        if (size > 0) fcntl(mid[1], F_SETPIPE_SZ, size);
+        bool teed = false;
+        int err = 0;
+        size_t have[n];     // bytes of the chunk each target got by tee
+        for (;;) {
+            // wait for data and take a first, non-consuming copy
+            ssize_t len = tee(in, mid[1], FANOUT_CHUNK, 0);
+            if (len < 0 && errno == EINTR) continue;
+            if (len <= 0) {
+                err = len < 0 ? errno : 0;
+                break;
+            }
+            teed = true;
+            bool whole = true;
+            have[0] = (size_t)len;
+            have[n - 1] = 0;
+            move(mid[0], &targets[0], (size_t)len);
+            for (size_t i = 1; i + 1 < n; i++) {
+                ssize_t t;
+                do {
+                    t = tee(in, mid[1], (size_t)len, 0);
+                } while (t < 0 && errno == EINTR);
+                have[i] = t > 0 ? (size_t)t : 0;
+                if (t > 0) move(mid[0], &targets[i], (size_t)t);
+                if (have[i] < (size_t)len) whole = false;
+            }
+            // the last target consumes exactly the bytes teed
+            if (whole) move(in, &targets[n - 1], (size_t)len);
+            else finish_chunk(in, targets, have, n, (size_t)len);
+        }
+        close(mid[0]);
+        close(mid[1]);
+        if (teed || err != EINVAL) return;
+    }
+#endif
+    // no tee(2): one read, n writes
+    for (;;) {
+        ssize_t k = read(in, rw_buf, sizeof rw_buf);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) break;
+        for (size_t i = 0; i < n; i++) {
+            if (targets[i].fd >= 0 && !write_all(targets[i].fd, rw_buf, (size_t)k)) {
+                drop(&targets[i]);
+            }
+        }
+    }
+}
+
+int fanout_start(int fd, int *outs, size_t n) {
+    int p[2];
+    if (pipe(p) < 0) {
+        perror("multios: pipe");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("multios: fork");
+        close(p[0]);
+        close(p[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // the command
+        dup2(p[1], fd);
+        if (p[1] != fd) close(p[1]);
+        close(p[0]);
+        for (size_t i = 0; i < n; i++) {
+            if (outs[i] != fd) close(outs[i]);
+        }
+        return 0;
+    }
+
+    // the copier: outlive the command's ^C to flush what it wrote, and
+    // hold nothing that would keep its input pipe from closing
+    close(p[1]);
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    int null = open("/dev/null", O_RDONLY);
+    if (null >= 0) {
+        dup2(null, STDIN_FILENO);
+        close(null);
+    }
+
+    Target targets[n];
+    for (size_t i = 0; i < n; i++) targets[i] = (Target){ outs[i], true };
+    copy_out(p[0], targets, n);
+    close(p[0]);
+    for (size_t i = 0; i < n; i++) {
+        if (targets[i].fd >= 0) close(targets[i].fd);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) _exit(1);
+    }
+    if (WIFSIGNALED(status)) {
+        // die the same way, so the shell reports it as the command's
+        int sig = WTERMSIG(status);
+        signal(sig, SIG_DFL);
+        kill(getpid(), sig);
+        _exit(128 + sig);
+    }
+    _exit(WEXITSTATUS(status));
+}
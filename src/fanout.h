@@ -0,0 +1,23 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stddef.h>
+
+/* Output to several places at once (zsh's MULTIOS): `cmd > a > b | c`
+* sends everything cmd writes on stdout to a, to b and down the pipe.
+* The fd is pointed at an internal pipe and the bytes are copied out by
+* the shell, not by a tee binary: tee(2) duplicates the pipe's pages
+* into a second pipe for each extra target and splice(2) moves them to
+* it, so the data is never copied through user space. Targets splice
+* can't write (files opened for append) fall back to read/write.
+*/
+
+/* In an already-forked child: split fd across the n open fds in outs
+* (which are closed). Forks again; the new child returns 0 to go on and
+* run the command with fd on the pipe, while this process copies until
+* the command is done and exits with its status, so whoever waits for
+* it sees every target complete. -1 if the pipe or fork failed.
+*/
+int fanout_start(int fd, int *outs, size_t n);
+
+#endif // FANOUT_H
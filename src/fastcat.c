@@ -0,0 +1,199 @@
+#include "fastcat.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#define KERNEL_CHUNK (1 << 30)  // bytes asked for per kernel copy call
+#define RW_BUF_SIZE  131072     // last-resort read/write buffer
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+// errno values meaning "this copy method can't handle these fds"
+static bool unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV ||
+           err == EOPNOTSUPP || err == EBADF || err == ESPIPE;
+}
+
+/* ---------- Copy methods ----------
+ * Each returns 1 at end of input, 0 if the method can't copy between
+ * these fds (the next one is tried from the current offsets), or -1 on
+ * error with errno set.
+ */
+#ifdef __linux__
+static int copy_range(int in, int out) {
+    for (;;) {
+        ssize_t n = copy_file_range(in, NULL, out, NULL, KERNEL_CHUNK, 0);
+        if (n > 0) continue;
+        if (n == 0) return 1;
+        if (errno == EINTR && !interrupted) continue;
+        return unsupported(errno) ? 0 : -1;
+    }
+}
+
+static int copy_splice(int in, int out) {
+    for (;;) {
+        ssize_t n = splice(in, NULL, out, NULL, KERNEL_CHUNK, SPLICE_F_MOVE);
+        if (n > 0) continue;
+        if (n == 0) return 1;
+        if (errno == EINTR && !interrupted) continue;
+        return unsupported(errno) ? 0 : -1;
+    }
+}
+
+static int copy_sendfile(int in, int out) {
+    for (;;) {
+        ssize_t n = sendfile(out, in, NULL, KERNEL_CHUNK);
+        if (n > 0) continue;
+        if (n == 0) return 1;
+        if (errno == EINTR && !interrupted) continue;
+        return unsupported(errno) ? 0 : -1;
+    }
+}
+#endif
+
+// Plain read/write: works for anything (ttys, O_APPEND files, ...)
+static int copy_rw(int in, int out, bool *write_failed) {
+    static char buf[RW_BUF_SIZE];
+    for (;;) {
+        ssize_t n = read(in, buf, sizeof buf);
+        if (n == 0) return 1;
+        if (n < 0) {
+            if (errno == EINTR && !interrupted) continue;
+            return -1;
+        }
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0) {
+                if (errno == EINTR && !interrupted) continue;
+                *write_failed = true;
+                return -1;
+            }
+            off += w;
+        }
+    }
+}
+
+/* ---------- Driver ---------- */
+
+// Copy fd in to stdout with the cheapest method the pair allows
+static int copy_fd(int in, const struct stat *in_st, const struct stat *out_st,
+                   bool *write_failed) {
+    int rc = 0;
+#ifdef __linux__
+    bool in_reg = S_ISREG(in_st->st_mode), out_reg = out_st && S_ISREG(out_st->st_mode);
+    bool any_pipe = S_ISFIFO(in_st->st_mode) || (out_st && S_ISFIFO(out_st->st_mode));
+
+    // zero-sized regular files (/proc, /sys) only yield data to read(2)
+    if (in_reg && in_st->st_size == 0) return copy_rw(in, STDOUT_FILENO, write_failed);
+
+    if (in_reg && out_reg) rc = copy_range(in, STDOUT_FILENO);
+    if (rc == 0 && any_pipe) rc = copy_splice(in, STDOUT_FILENO);
+    if (rc == 0 && in_reg) rc = copy_sendfile(in, STDOUT_FILENO);
+#else
+    (void)in_st;
+    (void)out_st;
+#endif
+    if (rc == 0) rc = copy_rw(in, STDOUT_FILENO, write_failed);
+    return rc;
+}
+
+// cat one operand; returns 0, 1 after an error message, or 128+SIGPIPE
+static int cat_operand(const char *name, const struct stat *out_st) {
+    bool is_stdin = strcmp(name, "-") == 0;
+    int in = is_stdin ? STDIN_FILENO : open(name, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+
+    int status = 0;
+    struct stat in_st;
+    if (fstat(in, &in_st) < 0) {
+        fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+        status = 1;
+    } else if (S_ISDIR(in_st.st_mode)) {
+        fprintf(stderr, "cat: %s: %s\n", name, strerror(EISDIR));
+        status = 1;
+    } else if (out_st && S_ISREG(out_st->st_mode) &&
+               in_st.st_dev == out_st->st_dev && in_st.st_ino == out_st->st_ino &&
+               lseek(in, 0, SEEK_CUR) < in_st.st_size) {
+        // same check as cat(1): copying would never reach end of input
+        fprintf(stderr, "cat: %s: input file is output file\n", name);
+        status = 1;
+    } else {
+        bool write_failed = false;
+        if (copy_fd(in, &in_st, out_st, &write_failed) < 0 && !interrupted) {
+            if (errno == EPIPE) {
+                status = 128 + SIGPIPE;   // cat would have died silently
+            } else if (write_failed || errno == ENOSPC || errno == EDQUOT) {
+                fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+                status = 1;
+            } else {
+                fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+                status = 1;
+            }
+        }
+    }
+
+    if (!is_stdin) close(in);
+    return status;
+}
+
+bool fastcat_supported(char *const *argv) {
+    for (size_t i = 1; argv[i]; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--") == 0) return true;
+        if (a[0] != '-' || a[1] == '\0') continue;
+        // GNU cat takes options anywhere; only -u (a no-op) is handled here
+        if (strspn(a + 1, "u") != strlen(a + 1)) return false;
+    }
+    return true;
+}
+
+int fastcat_run(char *const *argv) {
+    // Ctrl-C stops the copy (no SA_RESTART, so blocked calls return)
+    struct sigaction sa, old_int, old_pipe;
+    memset(&sa, 0, sizeof sa);
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = on_interrupt;
+    sigaction(SIGINT, &sa, &old_int);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, &old_pipe);
+    interrupted = 0;
+    fflush(stdout);
+
+    struct stat out_buf;
+    const struct stat *out_st = fstat(STDOUT_FILENO, &out_buf) == 0 ? &out_buf : NULL;
+
+    int status = 0;
+    bool operands = false, options_done = false;
+    for (size_t i = 1; argv[i] && !interrupted && status < 128; i++) {
+        const char *a = argv[i];
+        if (!options_done && strcmp(a, "--") == 0) {
+            options_done = true;
+            continue;
+        }
+        if (!options_done && a[0] == '-' && a[1] != '\0') continue;    // -u
+        operands = true;
+        int st = cat_operand(a, out_st);
+        if (st > status) status = st;
+    }
+    if (!operands && !interrupted) status = cat_operand("-", out_st);
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    return interrupted ? 128 + SIGINT : status;
+}
@@ -0,0 +1,19 @@
+#ifndef FASTCAT_H
+#define FASTCAT_H
+
+#include <stdbool.h>
+
+/* In-shell cat.
+* Copies each operand (or stdin) to stdout inside the kernel:
+* copy_file_range between regular files, splice when either side is a
+* pipe, sendfile otherwise, and plain read/write only as a last resort.
+* Only operands and -u are understood; anything else goes to /bin/cat.
+*/
+
+// true if argv (argv[0] == "cat") needs no option fastcat lacks
+bool fastcat_supported(char *const *argv);
+
+// Run cat with argv; returns its exit status like cat(1)
+int fastcat_run(char *const *argv);
+
+#endif // FASTCAT_H
@@ -0,0 +1,453 @@
+#include "highlight.h"
+#include "executor.h"
+#include "vars.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Colour classes
+enum {
+    HL_PLAIN,
+    HL_GOOD,                // command that resolves
+    HL_BAD,                 // command that does not
+    HL_STRING,
+    HL_VARIABLE,
+    HL_REDIRECT,
+    HL_OPERATOR,
+    HL_COMMENT,
+    HL_WORDCHAR             // unquoted word byte, coloured when the word ends
+};
+
+static const char *const sgr[] = {
+    "\033[0m", "\033[0;32m", "\033[0;31m", "\033[0;33m",
+    "\033[0;36m", "\033[0;35m", "\033[0;1m", "\033[0;90m", "\033[0m"
+};
+
+// Scanner flags
+enum {
+    HLF_WORD    = 1 << 0,   // inside a word
+    HLF_CMD     = 1 << 1,   // this (or the next) word is a command name
+    HLF_TARGET  = 1 << 2,   // the next word is a redirection target
+    HLF_ESC     = 1 << 3,   // after a backslash
+    HLF_VAR     = 1 << 4,   // inside $name or ${...}
+    HLF_COMMENT = 1 << 5,
+    HLF_BRACE   = 1 << 6    // inside ${...}
+};
+
+static bool enabled = true;
+
+bool hl_enabled(void) {
+    return enabled;
+}
+
+void hl_set_enabled(bool on) {
+    enabled = on;
+}
+
+void hl_init(Highlighter *h) {
+    memset(h, 0, sizeof *h);
+}
+
+void hl_free(Highlighter *h) {
+    free(h->cls);
+    free(h->state);
+    hl_init(h);
+}
+
+/* ---------- Executable cache ----------
+ * One set of entry names per PATH directory. Whether an entry is really
+ * executable is checked (and remembered) only when a name hits it.
+ */
+typedef struct {
+    char *path;
+    time_t mtime_sec;
+    long mtime_nsec;
+    bool loaded;
+    char **names;           // open addressing, NULL = empty slot
+    signed char *exec;      // per slot: -1 unknown, 0 no, 1 yes
+    size_t cap;
+} ExecDir;
+
+static ExecDir *exec_dirs = NULL;
+static size_t num_exec_dirs = 0;
+static char *exec_path = NULL;     // the PATH the table was built for
+static time_t exec_checked = 0;
+
+static uint32_t hash_name(const char *s) {
+    uint32_t h = 2166136261u;      // FNV-1a
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static void dir_clear(ExecDir *d) {
+    for (size_t i = 0; i < d->cap; i++) free(d->names[i]);
+    free(d->names);
+    free(d->exec);
+    d->names = NULL;
+    d->exec = NULL;
+    d->cap = 0;
+    d->loaded = false;
+}
+
+static void dir_insert(ExecDir *d, const char *name) {
+    size_t mask = d->cap - 1;
+    for (size_t i = hash_name(name) & mask; ; i = (i + 1) & mask) {
+        if (!d->names[i]) {
+            d->names[i] = strdup(name);
+            return;
+        }
+        if (strcmp(d->names[i], name) == 0) return;
+    }
+}
+
+static void dir_load(ExecDir *d) {
+    dir_clear(d);
+    d->loaded = true;
+    DIR *dir = opendir(d->path);
+    if (!dir) return;
+    size_t count = 0;
+    while (readdir(dir)) count++;
+    rewinddir(dir);
+
+    d->cap = 16;
+    while (d->cap < 2 * count) d->cap *= 2;     // at most half full
+    d->names = calloc(d->cap, sizeof *d->names);
+    d->exec = malloc(d->cap);
+    memset(d->exec, -1, d->cap);
+    struct dirent *e;
+    for (size_t n = 0; n < count && (e = readdir(dir)); n++) {
+        if (e->d_name[0] == '.' && (!e->d_name[1] || strcmp(e->d_name, "..") == 0)) continue;
+        if (e->d_type == DT_DIR) continue;
+        dir_insert(d, e->d_name);
+    }
+    closedir(dir);
+}
+
+static void dirs_free(void) {
+    for (size_t i = 0; i < num_exec_dirs; i++) {
+        dir_clear(&exec_dirs[i]);
+        free(exec_dirs[i].path);
+    }
+    free(exec_dirs);
+    exec_dirs = NULL;
+    num_exec_dirs = 0;
+}
+
+// Follow PATH changes; notice changed directories (once a second)
+static void dirs_refresh(void) {
+    const char *path = var_get("PATH");
+    if (!path) path = "/usr/local/bin:/usr/bin:/bin";
+    if (!exec_path || strcmp(path, exec_path) != 0) {
+        dirs_free();
+        free(exec_path);
+        exec_path = strdup(path);
+        exec_checked = 0;
+        for (const char *p = path; ; ) {
+            size_t n = strcspn(p, ":");
+            ExecDir *tmp = realloc(exec_dirs, (num_exec_dirs + 1) * sizeof *tmp);
+            if (!tmp) break;
+            exec_dirs = tmp;
+            exec_dirs[num_exec_dirs++] = (ExecDir){ .path = n ? strndup(p, n) : strdup(".") };
+            if (!p[n]) break;
+            p += n + 1;
+        }
+    }
+
+    time_t now = time(NULL);
+    if (now == exec_checked) return;
+    exec_checked = now;
+    for (size_t i = 0; i < num_exec_dirs; i++) {
+        ExecDir *d = &exec_dirs[i];
+        struct stat st;
+        if (stat(d->path, &st) < 0) st.st_mtim.tv_sec = 0, st.st_mtim.tv_nsec = 0;
+        if (st.st_mtim.tv_sec != d->mtime_sec || st.st_mtim.tv_nsec != d->mtime_nsec) {
+            d->mtime_sec = st.st_mtim.tv_sec;
+            d->mtime_nsec = st.st_mtim.tv_nsec;
+            d->loaded = false;      // read again when next needed
+        }
+    }
+}
+
+static bool in_path(const char *name) {
+    dirs_refresh();
+    uint32_t hash = hash_name(name);
+    for (size_t k = 0; k < num_exec_dirs; k++) {
+        ExecDir *d = &exec_dirs[k];
+        if (!d->loaded) dir_load(d);
+        if (d->cap == 0) continue;
+        size_t mask = d->cap - 1;
+        for (size_t i = hash & mask; d->names[i]; i = (i + 1) & mask) {
+            if (strcmp(d->names[i], name) != 0) continue;
+            if (d->exec[i] < 0) {
+                char full[strlen(d->path) + strlen(name) + 2];
+                snprintf(full, sizeof full, "%s/%s", d->path, name);
+                d->exec[i] = access(full, X_OK) == 0;
+            }
+            if (d->exec[i]) return true;
+            break;
+        }
+    }
+    return false;
+}
+
+/* ---------- Words ---------- */
+
+// Reserved words; those in the first group are followed by a command
+static const char *const keywords_then_cmd[] = {
+    "if", "then", "else", "elif", "do", "while", "until", "{", "!", "coproc", NULL
+};
+static const char *const keywords[] = {
+    "fi", "done", "esac", "}", "for", "case", "in", NULL
+};
+
+static bool in_list(const char *const *list, const char *s) {
+    for (size_t i = 0; list[i]; i++) {
+        if (strcmp(list[i], s) == 0) return true;
+    }
+    return false;
+}
+
+static bool is_assignment(const char *s) {
+    const char *eq = strchr(s, '=');
+    return eq && eq > s && var_valid_name(s, (size_t)(eq - s));
+}
+
+// The word in [start, end) is complete: colour its unquoted bytes
+static void finish_word(Highlighter *h, const char *buf, size_t start, size_t end,
+                        HlState *st) {
+    uint8_t cls = HL_PLAIN;
+    bool plain = true;      // nothing quoted or expanded: the name is known
+    for (size_t i = start; i < end; i++) plain &= h->cls[i] == HL_WORDCHAR;
+
+    if (st->flags & HLF_TARGET) {
+        st->flags &= (uint8_t)~HLF_TARGET;
+    } else if (st->flags & HLF_CMD) {
+        char name[256];
+        size_t n = end - start;
+        if (n < sizeof name) {
+            memcpy(name, buf + start, n);
+            name[n] = '\0';
+        }
+        if (!plain) {
+            st->flags &= (uint8_t)~HLF_CMD;
+        } else if (n >= sizeof name) {
+            cls = HL_BAD;
+            st->flags &= (uint8_t)~HLF_CMD;
+        } else if (is_assignment(name)) {
+            // NAME=value: the command is still to come
+        } else if (in_list(keywords_then_cmd, name)) {
+            cls = HL_GOOD;
+        } else {
+            if (in_list(keywords, name) || executor_has_command(name)) cls = HL_GOOD;
+            else if (strchr(name, '/')) cls = access(name, X_OK) == 0 ? HL_GOOD : HL_BAD;
+            else cls = in_path(name) ? HL_GOOD : HL_BAD;
+            st->flags &= (uint8_t)~HLF_CMD;
+        }
+    }
+    for (size_t i = start; i < end; i++) {
+        if (h->cls[i] == HL_WORDCHAR) h->cls[i] = cls;
+    }
+}
+
+/* ---------- Scanner ---------- */
+
+static bool is_op_char(char c) {
+    return c == '|' || c == '&' || c == ';' || c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+// [N]< > >> >& <& << <<- <<< &> &>>: length of the operator at p, or 0
+static size_t redirect_len(const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && p[i] >= '0' && p[i] <= '9') i++;
+    if (i < n && p[i] == '&' && i == 0) {
+        if (i + 1 < n && p[i + 1] == '>') return i + 2 < n && p[i + 2] == '>' ? 3 : 2;
+        return 0;
+    }
+    if (i >= n || (p[i] != '<' && p[i] != '>')) return 0;
+    char c = p[i++];
+    if (i < n && (p[i] == c || p[i] == '&')) {
+        i++;
+        if (c == '<' && p[i - 1] == '<' && i < n && (p[i] == '<' || p[i] == '-')) i++;
+    }
+    return i;
+}
+
+// | || |& & && ; ;; ( )
+static size_t operator_len(const char *p, size_t n) {
+    if (n > 1 && (p[0] == '|' || p[0] == '&' || p[0] == ';') && p[1] == p[0]) return 2;
+    if (n > 1 && p[0] == '|' && p[1] == '&') return 2;
+    return 1;
+}
+
+static void scan(Highlighter *h, const char *buf, size_t i, size_t len, HlState st) {
+    bool revisit = false;   // byte i is looked at again after a word ended
+    while (i < len) {
+        if (!revisit) h->state[i] = st;
+        revisit = false;
+        char c = buf[i];
+
+        if (st.flags & HLF_COMMENT) {
+            h->cls[i++] = HL_COMMENT;
+            continue;
+        }
+        if (st.flags & HLF_ESC) {
+            st.flags &= (uint8_t)~HLF_ESC;
+            h->cls[i++] = st.quote ? HL_STRING : HL_WORDCHAR;
+            continue;
+        }
+        if (st.flags & HLF_VAR) {
+            // $name, $?, $1, ${...}
+            bool first = buf[i - 1] == '$';
+            bool name_char = c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                             (c >= '0' && c <= '9');
+            if (st.flags & HLF_BRACE) {
+                if (c == '}') st.flags &= (uint8_t)~(HLF_VAR | HLF_BRACE);
+                h->cls[i++] = HL_VARIABLE;
+                continue;
+            }
+            if (first && (c == '{' || strchr("?$#@*!-0123456789", c))) {
+                if (c == '{') st.flags |= HLF_BRACE;
+                else st.flags &= (uint8_t)~HLF_VAR;
+                h->cls[i++] = HL_VARIABLE;
+                continue;
+            }
+            if (name_char) {
+                h->cls[i++] = HL_VARIABLE;
+                continue;
+            }
+            st.flags &= (uint8_t)~HLF_VAR;
+        }
+        if (st.quote == '\'') {
+            h->cls[i++] = HL_STRING;
+            if (c == '\'') st.quote = 0;
+            continue;
+        }
+        if (st.quote == '"') {
+            if (c == '\\') st.flags |= HLF_ESC;
+            else if (c == '"') st.quote = 0;
+            else if (c == '$') st.flags |= HLF_VAR;
+            h->cls[i++] = c == '$' ? HL_VARIABLE : HL_STRING;
+            continue;
+        }
+
+        if (st.flags & HLF_WORD) {
+            if (c == ' ' || c == '\t' || c == '\n' || is_op_char(c)) {
+                finish_word(h, buf, st.word_start, i, &st);
+                st.flags &= (uint8_t)~HLF_WORD;
+                revisit = true;
+                continue;
+            }
+        } else {
+            if (c == ' ' || c == '\t' || c == '\n') {
+                h->cls[i++] = HL_PLAIN;
+                continue;
+            }
+            if (c == '#') {
+                st.flags |= HLF_COMMENT;
+                revisit = true;
+                continue;
+            }
+            size_t n = redirect_len(buf + i, len - i);
+            if (n > 0) {
+                for (size_t k = 0; k < n; k++) {
+                    h->state[i + k] = st;
+                    h->cls[i + k] = HL_REDIRECT;
+                }
+                i += n;
+                st.flags |= HLF_TARGET;
+                continue;
+            }
+            if (is_op_char(c)) {
+                n = operator_len(buf + i, len - i);
+                for (size_t k = 0; k < n; k++) {
+                    h->state[i + k] = st;
+                    h->cls[i + k] = HL_OPERATOR;
+                }
+                i += n;
+                if (c == ')') st.flags &= (uint8_t)~HLF_CMD;
+                else st.flags |= HLF_CMD;
+                continue;
+            }
+            st.flags |= HLF_WORD;
+            st.word_start = (uint32_t)i;
+        }
+
+        // a byte of an unquoted word
+        if (c == '\\') st.flags |= HLF_ESC;
+        else if (c == '\'' || c == '"') st.quote = (uint8_t)c;
+        else if (c == '$') st.flags |= HLF_VAR;
+        h->cls[i++] = c == '\'' || c == '"' ? HL_STRING
+                    : c == '$' ? HL_VARIABLE : HL_WORDCHAR;
+    }
+    h->state[len] = st;
+    if (st.flags & HLF_WORD) finish_word(h, buf, st.word_start, len, &st);
+}
+
+size_t hl_update(Highlighter *h, const char *buf, size_t len, size_t from) {
+    if (len + 1 > h->cap) {
+        size_t cap = h->cap ? h->cap : 256;
+        while (cap < len + 1) cap *= 2;
+        h->cls = realloc(h->cls, cap);
+        h->state = realloc(h->state, cap * sizeof *h->state);
+        h->cap = cap;
+    }
+    if (from > h->len) from = h->len;
+    if (from > len) from = len;
+
+    // back up over operator bytes (| may become ||) and to the start
+    // of the word the edit is in: its colour depends on all of it
+    size_t s = from;
+    HlState st = { 0, HLF_CMD, 0 };
+    for (;;) {
+        while (s > 0 && is_op_char(buf[s - 1]) && h->state[s - 1].quote == 0 &&
+               !(h->state[s - 1].flags & (HLF_WORD | HLF_ESC | HLF_COMMENT))) {
+            s--;
+        }
+        if (s > 0 && (h->state[s].flags & HLF_WORD) && h->state[s].word_start < s) {
+            s = h->state[s].word_start;
+            continue;
+        }
+        break;
+    }
+    if (s > 0) st = h->state[s];
+
+    // colours of the bytes before the edit, to see which ones change
+    size_t keep = from - s;
+    uint8_t old[keep ? keep : 1];
+    memcpy(old, h->cls + s, keep);
+
+    scan(h, buf, s, len, st);
+    h->len = len;
+    for (size_t i = 0; i < keep; i++) {
+        if (h->cls[s + i] != old[i]) return s + i;
+    }
+    return from;
+}
+
+size_t hl_render(const Highlighter *h, const char *buf, size_t from, size_t len,
+                 char **out, size_t *out_cap) {
+    size_t need = (len - from) * 9 + 8;     // worst case: a colour per byte
+    if (*out_cap < need) {
+        *out = realloc(*out, need);
+        *out_cap = need;
+    }
+    char *p = *out;
+    int cur = -1;
+    for (size_t i = from; i < len; i++) {
+        if (h->cls[i] != cur) {
+            cur = h->cls[i];
+            size_t n = strlen(sgr[cur]);
+            memcpy(p, sgr[cur], n);
+            p += n;
+        }
+        *p++ = buf[i];
+    }
+    memcpy(p, "\033[0m", 4);
+    p += 4;
+    return (size_t)(p - *out);
+}
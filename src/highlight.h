@@ -0,0 +1,52 @@
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Syntax highlighting for the line editor (set -o highlight, on by
+* default). Command words are green when they resolve to a builtin,
+* function, keyword or an executable and red otherwise; quoted strings,
+* $variables, redirections, operators and comments get colours of
+* their own.
+* Work per keystroke is kept to the edit: the scanner's state before
+* every byte is remembered, so after a change at byte N scanning
+* resumes at the start of the word holding N, and only bytes whose
+* colour changed are repainted. Command names are looked up in a cached
+* set of each PATH directory's entries; a directory is re-read only
+* when its mtime changes, and mtimes are checked at most once a second.
+*/
+
+typedef struct {
+    uint8_t quote;          // 0, '\'' or '"'
+    uint8_t flags;          // HL_* scanner flags
+    uint32_t word_start;    // first byte of the word being scanned
+} HlState;
+
+typedef struct {
+    uint8_t *cls;           // colour class of each byte
+    HlState *state;         // scanner state before each byte
+    size_t len;             // bytes scanned
+    size_t cap;
+} Highlighter;
+
+void hl_init(Highlighter *h);
+void hl_free(Highlighter *h);
+
+bool hl_enabled(void);
+void hl_set_enabled(bool on);
+
+/* buf[0..len) is the new line, identical to the last one before byte
+* from. Rescans what the edit can affect and returns the first byte
+* whose colour may have changed: repaint from there to the end.
+*/
+size_t hl_update(Highlighter *h, const char *buf, size_t len, size_t from);
+
+/* Write buf[from..len) with colour escapes into *out (grown as needed),
+* ending in the default colour. Returns the length written.
+*/
+size_t hl_render(const Highlighter *h, const char *buf, size_t from, size_t len,
+                 char **out, size_t *out_cap);
+
+#endif // HIGHLIGHT_H
@@ -1,9 +1,12 @@
 #include "history.h"
- 
+#include "linereader.h"
+
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
 
 static char *xstrdup(const char *s) {
     if (!s) return NULL;
@@ -68,13 +71,149 @@ void history_add(History *h, const char *line) {
     }
 }
 
-void history_print(const History *h) {
+// Index in items of the entry at offset i from the oldest
+static size_t slot(const History *h, size_t i) {
+    return (h->head + h->capacity - h->count + i) % h->capacity;
+}
+
+void history_clear(History *h) {
+    if (!h || !h->items) return;
+    for (size_t i = 0; i < h->count; i++) {
+        size_t idx = slot(h, i);
+        free(h->items[idx]);
+        h->items[idx] = NULL;
+    }
+    h->base = 1;
+    h->count = 0;
+}
+
+bool history_delete(History *h, size_t n) {
+    if (!h || n < h->base || n >= h->base + h->count) return false;
+    size_t off = n - h->base;
+    free(h->items[slot(h, off)]);
+    for (size_t i = off; i + 1 < h->count; i++) {
+        h->items[slot(h, i)] = h->items[slot(h, i + 1)];
+    }
+    h->items[slot(h, h->count - 1)] = NULL;
+    h->head = (h->head + h->capacity - 1) % h->capacity;
+    h->count--;
+    return true;
+}
+
+void history_resize(History *h, size_t capacity) {
+    if (!h || capacity == 0 || capacity == h->capacity) return;
+    char **items = calloc(capacity, sizeof *items);
+    if (!items) return;
+    size_t keep = h->count < capacity ? h->count : capacity;
+    size_t drop = h->count - keep;
+    for (size_t i = 0; i < h->count; i++) {
+        char *line = h->items[slot(h, i)];
+        if (i < drop) free(line);
+        else items[i - drop] = line;
+    }
+    free(h->items);
+    h->items = items;
+    h->capacity = capacity;
+    h->count = keep;
+    h->head = keep % capacity;
+    h->base += drop;
+}
+
+/* ---------- Listing ---------- */
+
+#define PRINT_BUF_SIZE (256 * 1024)
+
+typedef struct {
+    char *buf;
+    size_t len;
+} OutBuf;
+
+static void out_flush(OutBuf *o) {
+    if (o->len > 0) fwrite(o->buf, 1, o->len, stdout);
+    o->len = 0;
+}
+
+// "%5zu  %s\n" without printf
+static void out_entry(OutBuf *o, size_t num, const char *line) {
+    size_t n = strlen(line);
+    if (o->len + n + 24 > PRINT_BUF_SIZE) {
+        out_flush(o);
+        if (n + 24 > PRINT_BUF_SIZE) {
+            printf("%5zu  %s\n", num, line);    // longer than the buffer
+            return;
+        }
+    }
+    char digits[20];
+    size_t d = 0;
+    do {
+        digits[d++] = (char)('0' + num % 10);
+        num /= 10;
+    } while (num > 0);
+    char *p = o->buf + o->len;
+    for (size_t pad = d; pad < 5; pad++) *p++ = ' ';
+    while (d > 0) *p++ = digits[--d];
+    *p++ = ' ';
+    *p++ = ' ';
+    memcpy(p, line, n);
+    p += n;
+    *p++ = '\n';
+    o->len = (size_t)(p - o->buf);
+}
+
+void history_print(const History *h, size_t last, const char *match) {
     if (!h || h->count == 0) return;
 
+    // with a filter, "last N" counts matching entries
+    size_t first = 0;
+    if (last > 0) {
+        size_t seen = 0;
+        first = h->count;
+        while (first > 0 && seen < last) {
+            const char *line = h->items[slot(h, --first)];
+            if (!match || (line && strstr(line, match))) seen++;
+        }
+    }
+
+    OutBuf o = { malloc(PRINT_BUF_SIZE), 0 };
+    if (!o.buf) return;
+    for (size_t i = first; i < h->count; i++) {
+        const char *line = h->items[slot(h, i)];
+        if (!line) line = "";
+        if (match && !strstr(line, match)) continue;
+        out_entry(&o, h->base + i, line);
+    }
+    out_flush(&o);
+    free(o.buf);
+}
+
+/* ---------- Files ---------- */
+
+int history_write(const History *h, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    static char buf[PRINT_BUF_SIZE];
+    setvbuf(f, buf, _IOFBF, sizeof buf);
     for (size_t i = 0; i < h->count; i++) {
-        size_t idx = (h->head + h->capacity - h->count + i) % h->capacity;
-        printf("%5zu  %s\n", h->base + i, h->items[idx] ? h->items[idx] : "");
+        const char *line = h->items[slot(h, i)];
+        fputs(line ? line : "", f);
+        fputc('\n', f);
     }
+    int err = ferror(f);
+    if (fclose(f) != 0 || err) return -1;
+    return 0;
+}
+
+int history_read(History *h, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    LineReader lr;
+    lr_open(&lr, fd, false);
+    size_t len;
+    const char *line;
+    while ((line = lr_next(&lr, &len))) history_add(h, line);
+    lr_close(&lr);
+    close(fd);
+    return 0;
 }
 
 // helper to fetch by 1-based number N
@@ -21,7 +21,28 @@ void history_init(History *h, size_t capacity);
 void history_free(History *h);
 
 void history_add(History *h, const char *line);
-void history_print(const History *h);
+
+// Drop every entry; numbering starts again at 1
+void history_clear(History *h);
+
+// Delete entry N (later entries move down a number); false if no such entry
+bool history_delete(History *h, size_t n);
+
+// Keep at most capacity entries (the newest), e.g. for $HISTSIZE
+void history_resize(History *h, size_t capacity);
+
+/* Print "  NUM  line" for the last `last` entries (0: all), only those
+* containing match if it is not NULL. Lines are formatted into one
+* large buffer and handed to stdout a buffer at a time, so a big
+* history costs a few writes, not one per entry.
+*/
+void history_print(const History *h, size_t last, const char *match);
+
+// Write entries to path, one per line; -1 (errno set) on failure
+int history_write(const History *h, const char *path);
+
+// Append the lines of path as entries; -1 (errno set) on failure
+int history_read(History *h, const char *path);
 
 /* Bang expansions.
 * !! - last entry
@@ -0,0 +1,151 @@
+#include "linereader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define LR_BLOCK (1u << 20)
+#define LR_DROP_EVERY (8 * (off_t)LR_BLOCK)    // release the page cache in 8 MiB steps
+
+void lr_open(LineReader *lr, int fd, bool shared) {
+    memset(lr, 0, sizeof *lr);
+    lr->fd = fd;
+    lr->shared = shared;
+    lr->cap = 2 * (size_t)LR_BLOCK;
+    lr->buf = malloc(lr->cap);
+
+    struct stat st;
+    lr->regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (lr->regular) {
+        lr->offset = lseek(fd, 0, SEEK_CUR);
+        if (lr->offset < 0) lr->offset = 0;
+        lr->dropped = lr->offset;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    lr->bytewise = shared && !lr->regular;
+    clock_gettime(CLOCK_MONOTONIC, &lr->started);
+}
+
+void lr_close(LineReader *lr) {
+    free(lr->buf);
+    lr->buf = NULL;
+}
+
+// Prefetch the block after this one; forget what is already executed
+static void advise(LineReader *lr) {
+    if (!lr->regular) return;
+    posix_fadvise(lr->fd, lr->offset, LR_BLOCK, POSIX_FADV_WILLNEED);
+    off_t consumed = lr->offset - (off_t)(lr->end - lr->start);
+    if (consumed - lr->dropped >= LR_DROP_EVERY) {
+        posix_fadvise(lr->fd, lr->dropped, consumed - lr->dropped, POSIX_FADV_DONTNEED);
+        lr->dropped = consumed;
+    }
+}
+
+/* Shared input that can't seek back (a pipe, a terminal): one byte at a
+ * time up to the newline, so the rest stays unread for the commands
+ */
+static ssize_t read_line_bytes(int fd, char *dst, size_t room) {
+    size_t n = 0;
+    while (n < room) {
+        ssize_t r = read(fd, dst + n, 1);
+        if (r <= 0) return n > 0 ? (ssize_t)n : r;
+        if (dst[n++] == '\n') break;
+    }
+    return (ssize_t)n;
+}
+
+// Read one more block after the unread bytes; false at end of input
+static bool fill(LineReader *lr) {
+    if (lr->eof || !lr->buf) return false;
+    // keep the partial line, at the front
+    size_t pending = lr->end - lr->start;
+    if (lr->start > 0) memmove(lr->buf, lr->buf + lr->start, pending);
+    lr->start = 0;
+    lr->end = pending;
+    if (lr->cap - lr->end <= LR_BLOCK) {
+        // a line longer than a block: grow to hold it
+        size_t cap = lr->cap * 2;
+        char *tmp = realloc(lr->buf, cap);
+        if (!tmp) return false;
+        lr->buf = tmp;
+        lr->cap = cap;
+    }
+
+    ssize_t n;
+    do {
+        size_t room = lr->cap - lr->end - 1;    // room for a NUL
+        n = lr->bytewise ? read_line_bytes(lr->fd, lr->buf + lr->end, room)
+                         : read(lr->fd, lr->buf + lr->end, room);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        if (n < 0) perror("read");
+        lr->eof = true;
+        return false;
+    }
+    lr->end += (size_t)n;
+    lr->offset += n;
+    lr->bytes += (uint64_t)n;
+    advise(lr);
+    return true;
+}
+
+// Shared regular file: where the fd is left is where the shell stopped
+static off_t consumed(const LineReader *lr) {
+    return lr->offset - (off_t)(lr->end - lr->start);
+}
+
+// A command moved the shared offset (read, head -1): continue from there
+static void resync(LineReader *lr) {
+    off_t pos = lseek(lr->fd, 0, SEEK_CUR);
+    if (pos < 0 || pos == consumed(lr)) return;
+    lr->start = lr->end = 0;
+    lr->offset = pos;
+    lr->eof = false;
+}
+
+// Hand the bytes read past this line back to the file
+static char *settle(LineReader *lr, char *line) {
+    if (lr->shared && lr->regular) lseek(lr->fd, consumed(lr), SEEK_SET);
+    return line;
+}
+
+char *lr_next(LineReader *lr, size_t *len) {
+    if (lr->shared && lr->regular) resync(lr);
+    for (;;) {
+        char *line = lr->buf + lr->start;
+        char *nl = lr->end > lr->start ? memchr(line, '\n', lr->end - lr->start) : NULL;
+        if (nl) {
+            *nl = '\0';
+            *len = (size_t)(nl - line);
+            lr->start += *len + 1;
+            lr->lines++;
+            return settle(lr, line);
+        }
+        if (!fill(lr)) break;
+    }
+    if (!lr->buf || lr->start == lr->end) return NULL;
+
+    // last line without a newline (fill() left room for the NUL)
+    char *line = lr->buf + lr->start;
+    *len = lr->end - lr->start;
+    line[*len] = '\0';
+    lr->start = lr->end;
+    lr->lines++;
+    return settle(lr, line);
+}
+
+void lr_report(const LineReader *lr, FILE *out) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double secs = (double)(now.tv_sec - lr->started.tv_sec) +
+                  (double)(now.tv_nsec - lr->started.tv_nsec) / 1e9;
+    double mib = (double)lr->bytes / (1024.0 * 1024.0);
+    if (secs <= 0) secs = 1e-9;
+    fprintf(out, "%llu lines, %.1f MiB in %.3f s: %.0f lines/s, %.1f MiB/s\n",
+            (unsigned long long)lr->lines, mib, secs,
+            (double)lr->lines / secs, mib / secs);
+}
@@ -0,0 +1,53 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+
+/* Streaming line reader for scripts and piped input.
+* Input is read in 1 MiB blocks into one buffer and lines are handed
+* out in place: memchr (vectorized in libc) finds each newline, and the
+* unfinished line at the end of a block moves to the front before the
+* next read. Memory stays at one block plus the longest line, however
+* big the file. For regular files the kernel is asked to prefetch the
+* next block while the current one runs, and pages already consumed are
+* dropped from the page cache so a multi-GB replay evicts nothing else.
+* Shared input (the shell's stdin, which the commands it runs also read)
+* must not be consumed past the current line: a regular file is seeked
+* back to the end of each line and re-read from wherever a command left
+* it; a pipe or terminal is read a byte at a time, as sh does.
+*/
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t start, end;      // unread bytes are buf[start, end)
+    bool eof;
+    bool regular;           // a regular file: fadvise applies
+    bool shared;            // commands read the fd too
+    bool bytewise;          // shared and can't seek: read up to a newline
+    off_t offset;           // file offset of buf[end]
+    off_t dropped;          // page cache released below this offset
+    uint64_t lines;
+    uint64_t bytes;
+    struct timespec started;
+} LineReader;
+
+// shared: commands also read fd, leave it at the end of each line
+void lr_open(LineReader *lr, int fd, bool shared);
+void lr_close(LineReader *lr);
+
+/* Next line without its newline, NUL-terminated in the reader's buffer
+* and valid until the next call; NULL at the end of input.
+*/
+char *lr_next(LineReader *lr, size_t *len);
+
+// "N lines, X MiB in T s: L lines/s, M MiB/s"
+void lr_report(const LineReader *lr, FILE *out);
+
+#endif // LINEREADER_H
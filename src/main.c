@@ -2,6 +2,19 @@
 #include "executor.h"
 #include "builtins.h"
 #include "history.h"
+#include "vars.h"
+#include "parsecache.h"
+#include "server.h"
+#include "prompt.h"
+#include "dirs.h"
+#include "sharedhist.h"
+#include "rcfile.h"
+#include "deadline.h"
+#include "coproc.h"
+#include "expand.h"
+#include "linereader.h"
+#include "highlight.h"
+#include "capture.h"
 #include "string.h"
 
 #include <stdio.h>
@@ -11,18 +24,29 @@
 #include <errno.h>
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
 
-ShellState shell_state = { "% " };
+ShellState shell_state = { "% ", 0, 0, NULL, 0, 0, 0, false, 0 };
 History history;
 
+extern char **environ;
+
 
 /* ---------- Helpers ---------- */
 static void reap_background_children(void) {
     int status;
+    deadline_check();   // background jobs run by timeout
     for (;;) {
         pid_t p = waitpid(-1, &status, WNOHANG);
         if (p > 0) {
+            if (prompt_reap(p)) continue;   // async prompt helper, not a job
+            if (procsub_reaped(p)) continue; // a background job's <(...) helper
+            deadline_reaped(p);
+            coproc_reaped(p);
             fprintf(stderr, "[background done pid %d]\n", (int)p);
+            if (shell_state.bg_jobs > 0) shell_state.bg_jobs--;
             continue;
         }
         if (p == 0) break; // nothing to reap
@@ -42,7 +66,52 @@ static void disable_raw_mode(const struct termios *orig_termios) {
     tcsetattr(STDIN_FILENO, TCSAFLUSH, orig_termios);
 }
 
-static ssize_t read_line_with_history(char **lineptr, size_t *n, const History *hist) {
+static Highlighter line_hl;
+static char *hl_out = NULL;
+static size_t hl_out_cap = 0;
+
+/* The screen shows `shown` bytes of the old input with the cursor after
+ * them; buf[0..len) is the new input, the same as the old before byte
+ * from. Repaint only what changed (with highlighting, the words whose
+ * colour the edit changed as well).
+ */
+static void show_edit(const char *buf, size_t len, size_t shown, size_t from) {
+    size_t p = hl_enabled() ? hl_update(&line_hl, buf, len, from) : from;
+    if (p > shown) p = shown;
+    if (shown > p) {
+        char left[32];
+        int n = snprintf(left, sizeof left, "\033[%zuD", shown - p);
+        write(STDOUT_FILENO, left, (size_t)n);
+    }
+    if (hl_enabled()) {
+        size_t n = hl_render(&line_hl, buf, p, len, &hl_out, &hl_out_cap);
+        write(STDOUT_FILENO, hl_out, n);
+    } else {
+        write(STDOUT_FILENO, buf + p, len - p);
+    }
+    if (len < shown) write(STDOUT_FILENO, "\033[K", 3);
+}
+
+// Redraw the prompt's last line and the input after an async segment changed
+static void repaint_line(const char *prompt, const char *buf, size_t len) {
+    const char *nl = strrchr(prompt, '\n');
+    const char *last = nl ? nl + 1 : prompt;
+    write(STDOUT_FILENO, "\r", 1);
+    write(STDOUT_FILENO, last, strlen(last));
+    if (hl_enabled()) {
+        size_t n = hl_render(&line_hl, buf, 0, len, &hl_out, &hl_out_cap);
+        write(STDOUT_FILENO, hl_out, n);
+    } else {
+        write(STDOUT_FILENO, buf, len);
+    }
+    write(STDOUT_FILENO, "\033[K", 3);
+}
+
+/* Line editor. With live set, the prompt comes from prompt_render() and
+ * is repainted in place when one of its async segments finishes.
+ */
+static ssize_t read_line_with_history(char **lineptr, size_t *n, History *hist,
+                                      const char *prompt, bool live) {
     struct termios orig;
     enable_raw_mode(&orig);
 
@@ -52,11 +121,34 @@ static ssize_t read_line_with_history(char **lineptr, size_t *n, const History *
 
     ssize_t hist_index = (ssize_t)hist->count; // one past last entry
     const char *current = NULL;
+    hl_update(&line_hl, buf, 0, 0);     // a new line: nothing scanned
 
-    write(STDOUT_FILENO, shell_state.prompt, strlen(shell_state.prompt));
+    write(STDOUT_FILENO, prompt, strlen(prompt));
 
     char c;
-    while (read(STDIN_FILENO, &c, 1) == 1) {
+    for (;;) {
+        // wait for a key, for an async prompt segment to finish, or
+        // for a background job's deadline
+        int afd = live ? prompt_async_fd() : -1;
+        int wait_ms = deadline_next_ms();
+        if (afd >= 0 || wait_ms >= 0) {
+            struct pollfd pfds[2] = {
+                { STDIN_FILENO, POLLIN, 0 },
+                { afd, POLLIN, 0 }
+            };
+            int ready = poll(pfds, 2, wait_ms);
+            if (ready < 0) continue;
+            if (ready == 0) {
+                deadline_check();
+                continue;
+            }
+            if (pfds[1].revents) {
+                if (prompt_async_finish()) repaint_line(prompt_rerender(), buf, len);
+                if (!pfds[0].revents) continue;
+            }
+        }
+        if (read(STDIN_FILENO, &c, 1) != 1) break;
+
         if (c == '\n' || c == '\r') {
             buf[len++] = '\0';
             write(STDOUT_FILENO, "\n", 1);
@@ -64,38 +156,50 @@ static ssize_t read_line_with_history(char **lineptr, size_t *n, const History *
         } else if (c == 127 || c == '\b') {        // backspace
             if (len > 0) {
                 len--;
-                write(STDOUT_FILENO, "\b \b", 3);
+                show_edit(buf, len, len + 1, len);
             }
         } else if (c == 27) {                      // ESC sequence
             char seq[2];
             if (read(STDIN_FILENO, seq, 2) == 2) {
                 if (seq[0] == '[' && seq[1] == 'A') { // Up arrow
+                    // starting to browse: pick up other sessions' lines first
+                    if (hist_index == (ssize_t)hist->count) {
+                        shist_import(hist);
+                        hist_index = (ssize_t)hist->count;
+                    }
                     if (hist->count > 0 && hist_index > 0) {
                         hist_index--;
                         current = hist->items[(hist->head + hist->capacity
                              - hist->count + (size_t)hist_index) % hist->capacity];
-                        // clear line
-                        for (size_t i = 0; i < len; i++) write(STDOUT_FILENO, "\b \b", 3);
+                        // replace the whole line
+                        size_t shown = len;
                         len = strlen(current);
-                        strncpy(buf, current, cap - 1);
-                        buf[len] = '\0';
-                        write(STDOUT_FILENO, current, len);
+                        if (len + 1 > cap) {
+                            cap = len + 1;
+                            buf = realloc(buf, cap);
+                        }
+                        memcpy(buf, current, len + 1);
+                        show_edit(buf, len, shown, 0);
                     }
                 } else if (seq[0] == '[' && seq[1] == 'B') { // Down arrow
                     if (hist_index < (ssize_t)hist->count - 1) {
                         hist_index++;
                         current = hist->items[(hist->head + hist->capacity
                              - hist->count + (size_t)hist_index) % hist->capacity];
-                        for (size_t i = 0; i < len; i++) write(STDOUT_FILENO, "\b \b", 3);
+                        size_t shown = len;
                         len = strlen(current);
-                        strncpy(buf, current, cap - 1);
-                        buf[len] = '\0';
-                        write(STDOUT_FILENO, current, len);
+                        if (len + 1 > cap) {
+                            cap = len + 1;
+                            buf = realloc(buf, cap);
+                        }
+                        memcpy(buf, current, len + 1);
+                        show_edit(buf, len, shown, 0);
                     } else if (hist_index == (ssize_t)hist->count - 1) {
                         hist_index++;
-                        for (size_t i = 0; i < len; i++) write(STDOUT_FILENO, "\b \b", 3);
+                        size_t shown = len;
                         len = 0;
                         buf[0] = '\0';
+                        show_edit(buf, len, shown, 0);
                     }
                 }
             }
@@ -105,7 +209,7 @@ static ssize_t read_line_with_history(char **lineptr, size_t *n, const History *
                 buf = realloc(buf, cap);
             }
             buf[len++] = c;
-            write(STDOUT_FILENO, &c, 1);
+            show_edit(buf, len, len - 1, len - 1);
         }
     }
 
@@ -116,25 +220,232 @@ static ssize_t read_line_with_history(char **lineptr, size_t *n, const History *
 }
 
 
+/* Read one line: through the line editor on a terminal, plainly otherwise.
+ * A NULL prompt means the main prompt, with its escapes expanded.
+ * Returns -1 at end of input.
+ */
+static ssize_t read_input_line(char **lineptr, size_t *n, LineReader *in,
+                               bool interactive, const char *prompt) {
+    if (interactive) {
+        bool live = !prompt;
+        if (live) prompt = prompt_render(shell_state.prompt);
+        ssize_t r = read_line_with_history(lineptr, n, &history, prompt, live);
+        return r <= 0 ? -1 : r;
+    }
+    size_t len;
+    const char *l = lr_next(in, &len);
+    if (!l) return -1;
+    if (*n < len + 1) {
+        char *tmp = realloc(*lineptr, len + 1);
+        if (!tmp) return -1;
+        *lineptr = tmp;
+        *n = len + 1;
+    }
+    memcpy(*lineptr, l, len + 1);
+    return (ssize_t)len;
+}
+
+// Append "\n" + more to *text (continuation line of a construct)
+static void append_line(char **text, const char *more) {
+    size_t a = strlen(*text), b = strlen(more);
+    char *tmp = realloc(*text, a + b + 2);
+    if (!tmp) return;
+    tmp[a] = '\n';
+    memcpy(tmp + a + 1, more, b + 1);
+    *text = tmp;
+}
+
+// Parse and run a -c command, updating $?; the shell exits right after,
+// so its last command may take over the process
+static void run_text(const char *text) {
+    JobList *list = pcache_parse(text);
+    if (list->incomplete) {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+        shell_state.last_status = 2;
+    } else if (list->error) {
+        shell_state.last_status = 2;
+    } else {
+        shell_state.last_status = execute_list_exec(list);
+    }
+    pcache_release(list);
+}
+
+
+/* ---------- Startup ----------
+ * Each phase is timed for --startup-profile; the clock reads cost a few
+ * tens of nanoseconds, so they stay in the normal path too.
+ */
+typedef struct {
+    const char *name;
+    double ms;
+} Phase;
+
+static Phase phases[8];
+static size_t num_phases = 0;
+static struct timespec phase_start;
+
+static double ms_between(const struct timespec *a, const struct timespec *b) {
+    return (double)(b->tv_sec - a->tv_sec) * 1e3 + (double)(b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+// End the current phase under name and start the next one
+static void phase_done(const char *name) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (num_phases < sizeof phases / sizeof *phases) {
+        phases[num_phases].name = name;
+        phases[num_phases++].ms = ms_between(&phase_start, &now);
+    }
+    phase_start = now;
+}
+
+// $HISTSIZE, from the environment or the rc file, sizes the history
+static void apply_histsize(void) {
+    const char *size = var_get("HISTSIZE");
+    char *end = NULL;
+    unsigned long n = size ? strtoul(size, &end, 10) : 0;
+    if (n > 0 && *end == '\0') history_resize(&history, (size_t)n);
+}
+
+// Parse (or map the snapshot of) the rc file and run it
+static void run_rc_file(RcStats *stats) {
+    const char *path = rc_path();
+    JobList *list = rc_load(path, stats);
+    phase_done("rc load");
+    if (!list) return;
+    if (list->incomplete) {
+        fprintf(stderr, "%s: syntax error: unexpected end of file\n", path);
+    } else if (!list->error) {
+        shell_state.last_status = execute_list(list);
+        phase_done("rc run");
+    }
+    rc_free(list);
+}
+
+static void print_startup_profile(const RcStats *rc) {
+    static const char *sources[] = {
+        "no rc file", "snapshot", "snapshot, rehashed", "parsed"
+    };
+    double total = 0;
+    fprintf(stderr, "startup profile:\n");
+    for (size_t i = 0; i < num_phases; i++) {
+        fprintf(stderr, "  %-14s %9.3f ms\n", phases[i].name, phases[i].ms);
+        total += phases[i].ms;
+    }
+    fprintf(stderr, "  %-14s %9.3f ms\n", "total", total);
+    const char *path = rc_path();
+    fprintf(stderr, "rc file: %s (%s", path ? path : "-", sources[rc->source]);
+    if (rc->source != RC_NONE) fprintf(stderr, ", %zu bytes", rc->bytes);
+    if (rc->saved) fprintf(stderr, ", snapshot written in %.3f ms", rc->save_ms);
+    fprintf(stderr, ")\n");
+}
+
+
 /* ---------- Main logic ---------- */
-int main(void) {
+// usage: myshell [-c COMMAND [ARGS...] | SCRIPT [ARGS...]]
+//        myshell --server SOCKET [--max-clients N]
+//        myshell --startup-profile
+//        myshell --throughput SCRIPT [ARGS...]  (report lines/s at the end)
+//        myshell --capture LOG [SCRIPT [ARGS...]]  (record a workload)
+//        myshell --replay LOG [--speed X]  (run it again and compare)
+int main(int argc, char **argv) {
     char *line = NULL;
     size_t n = 0;
+    int in_fd = STDIN_FILENO;
+    const char *command = NULL;
+    bool throughput = false;
+    RcStats rc = { RC_NONE, 0, 0, false, 0 };
 
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
     history_init(&history, 1000);
-    // ignore interactive signals in the shell process
-    signal(SIGINT, SIG_IGN); // 'ctrl-c'
-    signal(SIGQUIT, SIG_IGN); // 'ctrl-\'
-    signal(SIGTSTP, SIG_IGN); // 'ctrl-z'
+    phase_done("history");
+    vars_init(environ);
+    apply_histsize();
+    phase_done("environment");
+    dirs_init();
+    phase_done("pwd");
+    pcache_init(128);
+    phase_done("parse cache");
+    shell_state.shell_pid = getpid();
 
-    while (1) {
+    if (argc > 1 && strcmp(argv[1], "--startup-profile") == 0) {
+        run_rc_file(&rc);
         fflush(stdout);
+        print_startup_profile(&rc);
+        return shell_state.last_status;
+    }
 
-        ssize_t r = read_line_with_history(&line, &n, &history);
-        if (r <= 0) { putchar('\n'); break; }
+    if (argc > 2 && strcmp(argv[1], "--server") == 0) {
+        size_t max_clients = SERVER_DEFAULT_CLIENTS;
+        if (argc > 4 && strcmp(argv[3], "--max-clients") == 0) {
+            max_clients = (size_t)strtoul(argv[4], NULL, 10);
+        }
+        return server_run(argv[2], max_clients);
+    }
 
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+        double speed = 1;
+        if (argc > 4 && strcmp(argv[3], "--speed") == 0) speed = strtod(argv[4], NULL);
+        return cap_replay(argv[2], speed);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--throughput") == 0) {
+        throughput = true;
+        argv++;
+        argc--;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "--capture") == 0) {
+        if (!cap_open(argv[2])) return 1;
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+        command = argv[2];
+        shell_state.params = argv + 3;
+        shell_state.num_params = (size_t)(argc - 3);
+    } else if (argc > 1) {
+        in_fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (in_fd < 0) {
+            perror(argv[1]);
+            return 127;
+        }
+        shell_state.params = argv + 2;
+        shell_state.num_params = (size_t)(argc - 2);
+    }
+    bool interactive = !command && in_fd == STDIN_FILENO && isatty(STDIN_FILENO);
+
+    if (interactive) {
+        // ignore interactive signals in the shell process
+        signal(SIGINT, SIG_IGN); // 'ctrl-c'
+        signal(SIGQUIT, SIG_IGN); // 'ctrl-\'
+        signal(SIGTSTP, SIG_IGN); // 'ctrl-z'
+        const char *term = getenv("TERM");
+        if (term && strcmp(term, "dumb") == 0) hl_set_enabled(false);
+        dirs_set_recording(true);
+        run_rc_file(&rc);
+        apply_histsize();
+    }
+
+    if (command) {
+        run_text(command);
+        fflush(stdout);
+        return shell_state.last_status;
+    }
+
+    // scripts and piped input are streamed; stdin is shared with commands
+    LineReader in = { 0 };
+    if (!interactive) lr_open(&in, in_fd, in_fd == STDIN_FILENO);
+
+    while (1) {
+        fflush(stdout);
+
+        ssize_t r = read_input_line(&line, &n, &in, interactive, NULL);
+        if (r < 0) {
+            if (interactive) putchar('\n');
+            break;
+        }
 
         reap_background_children(); // clean up finished & jobs
 
@@ -145,8 +456,9 @@ int main(void) {
         // Trim leading whitespace
         char *trim = line;
         while (*trim == ' ' || *trim == '\t') trim++;
-        
-        if (trim[0] == '!') {
+
+        if (interactive && trim[0] == '!') {
+            shist_import(&history);
             if (history_expand_bang(&history, trim, &expanded)) {
                 printf("%s\n", expanded);  // echo the expanded command like Bash
                 to_parse = expanded;
@@ -157,28 +469,54 @@ int main(void) {
             }
         }
 
-        // add the effective command line to history
-        history_add(&history, to_parse);
-
-        // parse the line into one or more jobs
-        JobList list = parse_line(to_parse);
+        // parse the line into one or more jobs, reading more lines
+        // while a construct (if/while/quotes...) is still open
+        // (repeated lines come straight from the parse cache)
+        char *text = strdup(to_parse);
+        cap_begin();
+        uint64_t t = cap_now();
+        JobList *list = pcache_parse(text);
+        cap_add(CAP_PARSE, t);
+        while (list->incomplete) {
+            if (read_input_line(&line, &n, &in, interactive, "> ") < 0) {
+                fprintf(stderr, "syntax error: unexpected end of file\n");
+                break;
+            }
+            append_line(&text, line);
+            pcache_release(list);
+            t = cap_now();
+            list = pcache_parse(text);
+            cap_add(CAP_PARSE, t);
+        }
 
-        // iterate through each job and execute
-        for (size_t i = 0; i < list.count; i++) {
-            Job *job = list.jobs[i];
-            if (!job || job->num_cmds == 0) continue;
+        // add the effective command line to history
+        if (interactive) {
+            history_add(&history, text);
+            shist_append(text);
+        }
 
+        if (list->error || list->incomplete) {
+            shell_state.last_status = 2;
+        } else {
             // executor
-            execute_job(job);
+            shell_state.last_status = execute_list(list);
         }
-        // free everything parsed from this line
-        free_job_list(&list);
+        // drop our reference to the parsed line
+        pcache_release(list);
+        if (text[strspn(text, " \t")]) cap_end(text, shell_state.last_status);
 
+        free(text);
         free(expanded);
         reap_background_children(); // clean again after executing a line
     }
 
     free(line);
+    cap_close();
+    if (throughput) lr_report(&in, stderr);
+    lr_close(&in);
+    if (in_fd != STDIN_FILENO) close(in_fd);
     history_free(&history);
-    return 0;
+    pcache_free();
+    vars_free();
+    return shell_state.last_status;
 }
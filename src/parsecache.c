@@ -0,0 +1,166 @@
+#include "parsecache.h"
+#include "parser.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Entry {
+    JobList list;           // must stay first: handles point here
+    char *line;             // key (full text, checked on hash match)
+    uint64_t hash;
+    size_t refcount;        // cache's own reference + one per user
+    bool cached;            // still owned by the cache
+    struct Entry *hnext;    // hash bucket chain
+    struct Entry *prev;     // LRU list, most recent at head
+    struct Entry *next;
+} Entry;
+
+static Entry **buckets = NULL;
+static size_t num_buckets = 0;      // power of two
+static Entry *lru_head = NULL;
+static Entry *lru_tail = NULL;
+static size_t count = 0;
+static size_t capacity = 0;
+
+static size_t lookups = 0;
+static size_t hits = 0;
+
+/* ---------- Helpers ---------- */
+static uint64_t hash_line(const char *s) {
+    uint64_t h = 1469598103934665603ull; // FNV-1a
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void entry_unref(Entry *e) {
+    if (--e->refcount > 0) return;
+    free_job_list(&e->list);
+    free(e->line);
+    free(e);
+}
+
+static void lru_unlink(Entry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else lru_head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else lru_tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(Entry *e) {
+    e->prev = NULL;
+    e->next = lru_head;
+    if (lru_head) lru_head->prev = e;
+    lru_head = e;
+    if (!lru_tail) lru_tail = e;
+}
+
+static void bucket_remove(Entry *e) {
+    Entry **pp = &buckets[e->hash & (num_buckets - 1)];
+    while (*pp && *pp != e) pp = &(*pp)->hnext;
+    if (*pp) *pp = e->hnext;
+    e->hnext = NULL;
+}
+
+// Drop the cache's reference; users still running the list keep it alive
+static void evict(Entry *e) {
+    lru_unlink(e);
+    bucket_remove(e);
+    e->cached = false;
+    count--;
+    entry_unref(e);
+}
+
+static void evict_to(size_t limit) {
+    while (count > limit && lru_tail) evict(lru_tail);
+}
+
+static void rebuild_buckets(size_t cap) {
+    size_t n = 16;
+    while (n < cap * 2) n *= 2;
+
+    free(buckets);
+    buckets = calloc(n, sizeof *buckets);
+    num_buckets = n;
+    for (Entry *e = lru_head; e; e = e->next) {
+        size_t b = e->hash & (n - 1);
+        e->hnext = buckets[b];
+        buckets[b] = e;
+    }
+}
+
+/* ---------- Public API ---------- */
+void pcache_init(size_t cap) {
+    capacity = cap;
+    rebuild_buckets(cap);
+}
+
+void pcache_free(void) {
+    evict_to(0);
+    free(buckets);
+    buckets = NULL;
+    num_buckets = 0;
+}
+
+JobList *pcache_parse(const char *line) {
+    uint64_t h = hash_line(line);
+    lookups++;
+
+    if (capacity > 0) {
+        for (Entry *e = buckets[h & (num_buckets - 1)]; e; e = e->hnext) {
+            if (e->hash == h && strcmp(e->line, line) == 0) {
+                hits++;
+                lru_unlink(e);
+                lru_push_front(e);
+                e->refcount++;
+                return &e->list;
+            }
+        }
+    }
+
+    Entry *e = calloc(1, sizeof *e);
+    e->list = parse_line(line);
+    e->hash = h;
+    e->refcount = 1;    // caller's reference
+
+    // only complete, valid parses are worth keeping
+    if (capacity > 0 && !e->list.incomplete && !e->list.error) {
+        e->line = strdup(line);
+        e->cached = true;
+        e->refcount++;
+        size_t b = h & (num_buckets - 1);
+        e->hnext = buckets[b];
+        buckets[b] = e;
+        lru_push_front(e);
+        count++;
+        evict_to(capacity);
+    }
+    return &e->list;
+}
+
+void pcache_release(JobList *list) {
+    if (!list) return;
+    entry_unref((Entry *)list);
+}
+
+void pcache_resize(size_t cap) {
+    capacity = cap;
+    evict_to(cap);
+    rebuild_buckets(cap);
+}
+
+void pcache_clear(void) {
+    evict_to(0);
+    lookups = hits = 0;
+}
+
+void pcache_print_stats(void) {
+    double rate = lookups ? 100.0 * (double)hits / (double)lookups : 0.0;
+    printf("parse cache: %zu/%zu lines, %zu lookups, %zu hits (%.1f%%)\n",
+        count, capacity, lookups, hits, rate);
+}
@@ -0,0 +1,30 @@
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include "shelltypes.h"
+
+#include <stddef.h>
+
+/* LRU cache of parsed lines.
+* Maps the text of a line to its immutable parsed JobList, so repeated
+* lines (!!, !N, history recall, generated scripts) skip the tokenizer
+* and parser. Lists are shared, not copied: execution never modifies
+* the tree (expansion builds fresh argv arrays), and each user holds a
+* reference until pcache_release().
+*/
+
+void pcache_init(size_t capacity);
+void pcache_free(void);
+
+// Parse line, or reuse the cached tree. Never returns NULL.
+JobList *pcache_parse(const char *line);
+void pcache_release(JobList *list);
+
+// Change the number of cached lines (0 disables caching)
+void pcache_resize(size_t capacity);
+void pcache_clear(void);
+
+// Print size and hit rate
+void pcache_print_stats(void);
+
+#endif // PARSECACHE_H
@@ -1,10 +1,15 @@
 #include "parser.h"
 #include "shelltypes.h"
+#include "alias.h"
+#include "expand.h"
+#include "vars.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <stdint.h>
 
 /* ---------- Utilities ---------- */
 static void strip_trailing_newline(char *s) {
@@ -56,23 +61,56 @@ static void sv_free(StrVec *v) {
 /* ---------- Tokenizer ---------- */
 
 static int is_one_char_special(char c) {
-    return (c == '|' || c == ';' || c == '&' || c == '<' || c == '>');
+    return (c == '|' || c == ';' || c == '&' || c == '<' || c == '>' ||
+            c == '(' || c == ')');
+}
+
+// "&&", "||" and ";;" are single operator tokens
+static int is_two_char_op(const char *p) {
+    return (p[0] == '&' && p[1] == '&') ||
+           (p[0] == '|' && p[1] == '|') ||
+           (p[0] == ';' && p[1] == ';');
+}
+
+/* Length of a redirection operator at p, optionally preceded by an
+ * fd number: [N]<, [N]>, [N]>>, [N]<&, [N]>&, [N]<<, [N]<<-, [N]<<<,
+ * &>, &>>. 0 if none.
+ */
+static size_t redirect_op_len(const char *p) {
+    size_t n = 0;
+    if (p[0] == '&' && p[1] == '>') {
+        return p[2] == '>' ? 3 : 2;
+    }
+    while (isdigit((unsigned char)p[n])) n++;
+    if (p[n] == '<' && p[n + 1] == '<') {
+        return n + (p[n + 2] == '<' || p[n + 2] == '-' ? 3 : 2);
+    }
+    if (p[n] == '<') {
+        return n + (p[n + 1] == '&' ? 2 : 1);
+    }
+    if (p[n] == '>') {
+        return n + (p[n + 1] == '>' || p[n + 1] == '&' ? 2 : 1);
+    }
+    return 0;
 }
 
 typedef struct {
     char *buf;
     size_t len;
     size_t cap;
+    int quoted;     // token had quotes, keep it even if empty ("")
 } TokBuf;
 
 static void tb_init(TokBuf *tb) {
     tb->buf = NULL;
     tb->len = 0;
     tb->cap = 0;
+    tb->quoted = 0;
 }
 
 static void tb_reset(TokBuf *tb) {
     tb->len = 0;
+    tb->quoted = 0;
 }
 
 static int tb_reserve(TokBuf *tb, size_t need) {
@@ -93,10 +131,16 @@ static int tb_push_char(TokBuf *tb, char c) {
     return 1;
 }
 
+// Push a quoted/escaped char: marked literal for the expansion stage
+static int tb_push_literal(TokBuf *tb, char c) {
+    return tb_push_char(tb, CTL_ESC) && tb_push_char(tb, c);
+}
+
 /* Finish current token (if any) and push a strdup'ed copy into out */
 static int tb_finish_token(TokBuf *tb, StrVec *out) {
-    if (tb->len == 0) return 1; // nothing to push
-    char *copy = strdup(tb->buf);
+    if (tb->len == 0 && !tb->quoted) return 1; // nothing to push
+    // an empty quoted token ("") is kept as a lone marker
+    char *copy = strdup(tb->len ? tb->buf : (char[]){ CTL_ESC, '\0' });
     if (!copy) return 0;
     if (!sv_push(out, copy)) {
         free(copy);
@@ -106,15 +150,219 @@ static int tb_finish_token(TokBuf *tb, StrVec *out) {
     return 1;
 }
 
+/* Copy a parameter reference after '$' inside double quotes unmarked,
+ * so the expansion stage can still see its name. Returns bytes copied.
+*/
+static size_t tb_copy_param(TokBuf *tb, const char *p) {
+    size_t n = 0;
+    if (p[0] == '{') {
+        const char *end = strchr(p, '}');
+        if (!end) return 0;
+        n = (size_t)(end - p) + 1;
+    } else if (p[0] && strchr("?$#@*0123456789", p[0])) {
+        n = 1;
+    } else if (isalpha((unsigned char)p[0]) || p[0] == '_') {
+        while (isalnum((unsigned char)p[n]) || p[n] == '_') n++;
+    }
+    for (size_t i = 0; i < n; i++) tb_push_char(tb, p[i]);
+    return n;
+}
+
+/* Length of the text up to the ')' that closes an already consumed
+ * '(' (nested parens and quotes skipped). SIZE_MAX if unterminated.
+ */
+static size_t scan_subst(const char *p) {
+    int depth = 1;
+    for (size_t i = 0; p[i]; i++) {
+        char c = p[i];
+        if (c == '\\' && p[i + 1]) {
+            i++;
+        } else if (c == '\'' || c == '\"') {
+            while (p[++i] && p[i] != c) {
+                if (c == '\"' && p[i] == '\\' && p[i + 1]) i++;
+            }
+            if (!p[i]) return SIZE_MAX;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+// Keep raw substitution text in a token between a start marker and CTL_END
+static void tb_push_subst(TokBuf *tb, char marker, const char *text, size_t len) {
+    tb_push_char(tb, marker);
+    for (size_t i = 0; i < len; i++) tb_push_char(tb, text[i]);
+    tb_push_char(tb, CTL_END);
+}
+
+// Length of a `...` body up to its closing backquote. SIZE_MAX if unterminated.
+static size_t scan_backquote(const char *p) {
+    for (size_t i = 0; p[i]; i++) {
+        if (p[i] == '\\' && p[i + 1]) i++;
+        else if (p[i] == '`') return i;
+    }
+    return SIZE_MAX;
+}
+
+// Like tb_push_subst for a `...` body: \`, \\ and \$ lose their backslash
+static void tb_push_backquote(TokBuf *tb, const char *text, size_t len) {
+    tb_push_char(tb, CTL_CMDSUB);
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\\' && i + 1 < len && strchr("`\\$", text[i + 1])) i++;
+        tb_push_char(tb, text[i]);
+    }
+    tb_push_char(tb, CTL_END);
+}
+
+/* Push a $(list) or `list` starting at p into tb. Returns the number of
+ * bytes consumed, or 0 if the substitution is unterminated.
+ */
+static size_t tb_push_cmdsub(TokBuf *tb, const char *p) {
+    if (*p == '`') {
+        size_t n = scan_backquote(p + 1);
+        if (n == SIZE_MAX) return 0;
+        tb_push_backquote(tb, p + 1, n);
+        return n + 2;
+    }
+    size_t n = scan_subst(p + 2);
+    if (n == SIZE_MAX) return 0;
+    tb_push_subst(tb, CTL_CMDSUB, p + 2, n);
+    return n + 3;
+}
+
+/* ---------- Here-documents ----------
+ * The body of each <<WORD on a line starts after that line's newline.
+ * It replaces the WORD token, so the parser sees "<<" BODY like any
+ * other redirection. An unquoted delimiter leaves $ expansions and
+ * $(...)/`...` substitutions active in the body; a quoted one makes the
+ * whole body literal.
+ */
+
+// 1 for "<<", 2 for "<<-" (strip leading tabs), 0 otherwise
+static int heredoc_op(const char *t) {
+    size_t n = 0;
+    while (isdigit((unsigned char)t[n])) n++;
+    if (strcmp(t + n, "<<") == 0) return 1;
+    if (strcmp(t + n, "<<-") == 0) return 2;
+    return 0;
+}
+
+// Append one body line (with its newline) to tb, marked for expansion
+static void heredoc_push_line(TokBuf *tb, const char *s, size_t len, int quoted) {
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (quoted) {
+            tb_push_literal(tb, c);
+        } else if (c == '\\' && i + 1 < len && strchr("$\\`", s[i + 1])) {
+            tb_push_literal(tb, s[++i]);
+        } else if ((c == '$' && i + 1 < len && s[i + 1] == '(') || c == '`') {
+            // command substitution, not split (as inside double quotes);
+            // one that doesn't close on this line stays literal
+            size_t n = c == '`' ? scan_backquote(s + i + 1) : scan_subst(s + i + 2);
+            size_t total = n == SIZE_MAX ? 0 : n + (c == '`' ? 2 : 3);
+            if (total == 0 || total > len - i) {
+                tb_push_literal(tb, c);
+                continue;
+            }
+            tb_push_char(tb, CTL_QUOTED);
+            tb_push_cmdsub(tb, s + i);
+            i += total - 1;
+        } else if (c == '$') {
+            tb_push_char(tb, CTL_QUOTED);
+            tb_push_char(tb, '$');
+            i += tb_copy_param(tb, s + i + 1);
+        } else {
+            tb_push_literal(tb, c);
+        }
+    }
+    tb_push_literal(tb, '\n');
+}
+
+/* Read the bodies of here-documents among tokens [from, out->size),
+ * starting at *pp. Advances *pp past the last delimiter line.
+ * Returns 1 if the input ends before a delimiter.
+ */
+static int read_heredoc_bodies(StrVec *out, size_t from, char **pp) {
+    for (size_t i = from; i + 1 < out->size; i++) {
+        int op = heredoc_op(out->data[i]);
+        if (!op) continue;
+
+        // delimiter with quoting removed; any quoting makes the body literal
+        const char *word = out->data[i + 1];
+        int quoted = strchr(word, CTL_ESC) != NULL;
+        TokBuf delim;
+        tb_init(&delim);
+        for (const char *w = word; *w; w++) {
+            if (*w != CTL_ESC && *w != CTL_QUOTED) tb_push_char(&delim, *w);
+        }
+
+        TokBuf body;
+        tb_init(&body);
+        body.quoted = 1;
+        int found = 0;
+        char *p = *pp;
+        while (*p) {
+            char *eol = strchr(p, '\n');
+            size_t len = eol ? (size_t)(eol - p) : strlen(p);
+            if (op == 2) {
+                while (len > 0 && *p == '\t') { p++; len--; }
+            }
+            if (len == delim.len && (len == 0 || memcmp(p, delim.buf, len) == 0)) {
+                found = 1;
+                p += len;
+                if (*p) p++;
+                break;
+            }
+            heredoc_push_line(&body, p, len, quoted);
+            p += len;
+            if (*p) p++;
+        }
+        free(delim.buf);
+
+        if (!found) {
+            free(body.buf);
+            return 1;
+        }
+        free(out->data[i + 1]);
+        out->data[i + 1] = strdup(body.len ? body.buf : (char[]){ CTL_ESC, '\0' });
+        free(body.buf);
+        *pp = p;
+    }
+    return 0;
+}
+
+// Any here-document operator among tokens [from, out->size)?
+static int has_heredoc(const StrVec *out, size_t from) {
+    for (size_t i = from; i < out->size; i++) {
+        if (heredoc_op(out->data[i])) return 1;
+    }
+    return 0;
+}
+
 /* Tokenize with shell specials as separate tokens.
  * Whitespace separates tokens.
  * Quotes "" and '' create single tokens (stripped).
  * Inside single quotes, \ becomes '.
- * Inside double quotes, \ becomes ".
+ * Inside double quotes, \ escapes ", $, ` and \.
  * Backslash in normal mode escapes special chars, space, backslash itself.
  * Special tokens are separate tokens unless escaped/quoted.
+ * Redirection operators ([N]<, [N]>, [N]>>, [N]<&, [N]>&, [N]<<, [N]<<-,
+ * [N]<<<, &>, &>>) are single tokens including their fd number.
+ * Here-document bodies are read after the newline that ends their line.
+ * <(list), >(list), $(list) and `list` keep their raw text inside the
+ * word (see expand.h).
+ * A newline is its own token, and # starts a comment at a word start.
+ * Quoted and escaped chars are marked with CTL_ESC, and $ inside double
+ * quotes with CTL_QUOTED, for the expansion stage (see expand.h).
+ * Returns 1 if the input ends inside quotes, after a backslash, or
+ * inside a here-document or substitution.
 */
-static void tokenize_with_specials(char *buf, StrVec *out) {
+static int tokenize_with_specials(char *buf, StrVec *out) {
+    int incomplete = 0;
+    size_t line_start = 0;  // first token of the current line
     sv_init(out);
     TokBuf tb;
     tb_init(&tb);
@@ -123,41 +371,96 @@ static void tokenize_with_specials(char *buf, StrVec *out) {
 
     for (char *p = buf; ; ++p) {
         char c = *p;
+        size_t oplen;
 
         if (state == ST_NORMAL) {
             if (c == '\0') {
                 // end of input
                 tb_finish_token(&tb, out);
+                if (has_heredoc(out, line_start)) incomplete = 1;
                 break;
             } else if (c == ' ' || c == '\t') {
                 // whitespace ends token
                 tb_finish_token(&tb, out);
                 continue;
+            } else if (c == '\n') {
+                // newline separates commands like ';'
+                tb_finish_token(&tb, out);
+                char *tok = strdup("\n");
+                if (tok) sv_push(out, tok);
+
+                // here-document bodies follow this newline
+                char *next = p + 1;
+                if (read_heredoc_bodies(out, line_start, &next)) {
+                    incomplete = 1;
+                    break;
+                }
+                p = next - 1;
+                line_start = out->size;
+                continue;
+            } else if (c == '#' && tb.len == 0 && !tb.quoted) {
+                // comment runs to the end of the line
+                while (p[1] != '\0' && p[1] != '\n') ++p;
+                continue;
             } else if (c == '\'') {
                 // start single-quoted string
                 state = ST_IN_SQ;
+                tb.quoted = 1;
                 continue;
             } else if (c == '\"') {
                 // start double-quoted string
                 state = ST_IN_DQ;
+                tb.quoted = 1;
                 continue;
             } else if (c == '\\') {
                 // escape next char (space, special, backslash, etc.)
-                if (p[1] != '\0') {
+                if (p[1] == '\n') {
+                    // line continuation
                     ++p;
-                    tb_push_char(&tb, *p);
+                    continue;
+                } else if (p[1] != '\0') {
+                    ++p;
+                    tb_push_literal(&tb, *p);
                     continue;
                 } else {
-                    // trailing backslash at end: treat as literal
-                    tb_push_char(&tb, '\\');
+                    // trailing backslash at end: more input follows
+                    incomplete = 1;
                     continue;
                 }
-            } else if (c == '2' && p[1] == '>') {
-                // special two-char token "2>"
+            } else if ((c == '$' && p[1] == '(') || c == '`') {
+                // command substitution $(list) / `list`
+                size_t n = tb_push_cmdsub(&tb, p);
+                if (n == 0) {
+                    incomplete = 1;
+                    break;
+                }
+                p += n - 1;
+                continue;
+            } else if ((c == '<' || c == '>') && p[1] == '(') {
+                // process substitution <(list) / >(list)
+                size_t n = scan_subst(p + 2);
+                if (n == SIZE_MAX) {
+                    incomplete = 1;
+                    break;
+                }
+                tb_push_subst(&tb, c == '<' ? CTL_PROCSUB_IN : CTL_PROCSUB_OUT, p + 2, n);
+                p += 2 + n; // at ')'
+                continue;
+            } else if ((oplen = redirect_op_len(p)) > 0 &&
+                       (!isdigit((unsigned char)c) || (tb.len == 0 && !tb.quoted))) {
+                // redirection operator (an fd number only at a word start)
+                tb_finish_token(&tb, out);
+                char *tok = strndup(p, oplen);
+                if (tok) sv_push(out, tok);
+                p += oplen - 1;
+                continue;
+            } else if (is_two_char_op(p)) {
+                // "&&", "||", ";;"
                 tb_finish_token(&tb, out);
-                char *tok = strdup("2>");
+                char tmp[3] = { c, p[1], '\0' };
+                char *tok = strdup(tmp);
                 if (tok) sv_push(out, tok);
-                ++p; // skip '>'
+                ++p;
                 continue;
             } else if (is_one_char_special(c)) {
                 // single-character special token
@@ -175,42 +478,61 @@ static void tokenize_with_specials(char *buf, StrVec *out) {
             if (c == '\0') {
                 // unterminated quote: just finish the token
                 tb_finish_token(&tb, out);
+                incomplete = 1;
                 break;
             } else if (c == '\\' && p[1] == '\'') {
                 // escaped single quote inside single quotes
                 ++p;
-                tb_push_char(&tb, '\'');
+                tb_push_literal(&tb, '\'');
                 continue;
             } else if (c == '\'') {
                 // end single-quoted string
                 state = ST_NORMAL;
                 continue;
             } else {
-                tb_push_char(&tb, c);
+                tb_push_literal(&tb, c);
                 continue;
             }
         } else if (state == ST_IN_DQ) {
             if (c == '\0') {
                 // unterminated quote: finish token
                 tb_finish_token(&tb, out);
+                incomplete = 1;
                 break;
-            } else if (c == '\\' && p[1] == '\"') {
-                // escaped double quote inside double quotes
+            } else if (c == '\\' && (p[1] == '\"' || p[1] == '$' || p[1] == '\\' || p[1] == '`')) {
+                // escaped ", $, ` or \ inside double quotes
                 ++p;
-                tb_push_char(&tb, '\"');
+                tb_push_literal(&tb, *p);
                 continue;
             } else if (c == '\"') {
                 // end double-quoted string
                 state = ST_NORMAL;
                 continue;
+            } else if ((c == '$' && p[1] == '(') || c == '`') {
+                // command substitution inside quotes: not split
+                tb_push_char(&tb, CTL_QUOTED);
+                size_t n = tb_push_cmdsub(&tb, p);
+                if (n == 0) {
+                    incomplete = 1;
+                    break;
+                }
+                p += n - 1;
+                continue;
+            } else if (c == '$') {
+                // expansion inside quotes: expanded later, but not split
+                tb_push_char(&tb, CTL_QUOTED);
+                tb_push_char(&tb, '$');
+                p += tb_copy_param(&tb, p + 1);
+                continue;
             } else {
-                tb_push_char(&tb, c);
+                tb_push_literal(&tb, c);
                 continue;
             }
         }
     }
 
     free(tb.buf);
+    return incomplete;
 }
 
 
@@ -218,36 +540,69 @@ static void tokenize_with_specials(char *buf, StrVec *out) {
 
 static Command make_empty_command(void) {
     Command c;
+    c.kind = CMD_SIMPLE;
     c.argv = NULL;
-    c.input_file = NULL;
-    c.output_file = NULL;
-    c.error_file = NULL;
+    c.assigns = NULL;
+    c.redirs = NULL;
+    c.num_redirs = 0;
+    c.compound = NULL;
     return c;
 }
 
-static Command make_command_from_argv(StrVec *argv) {
-    Command cmd = make_empty_command();
-    cmd.argv = calloc(argv->size + 1, sizeof *cmd.argv);
-    for (size_t i = 0; i < argv->size; i++) {
-        cmd.argv[i] = argv->data[i]; //transfer ownership
-        argv->data[i] = NULL;
+// Transfer ownership of the strings in v into a NULL-terminated array
+static char **take_strings(StrVec *v) {
+    char **arr = calloc(v->size + 1, sizeof *arr);
+    for (size_t i = 0; i < v->size; i++) {
+        arr[i] = v->data[i];
+        v->data[i] = NULL;
     }
-    cmd.argv[argv->size] = NULL;
-    return cmd;
+    arr[v->size] = NULL;
+    sv_free(v);
+    return arr;
+}
+
+static void free_strings(char **arr) {
+    if (!arr) return;
+    for (size_t i = 0; arr[i]; i++)
+        free(arr[i]);
+    free(arr);
+}
+
+// NAME=value with an unquoted, valid NAME
+static int is_assignment_word(const char *t) {
+    const char *eq = strchr(t, '=');
+    return eq && var_valid_name(t, (size_t)(eq - t));
 }
 
 static void free_command(Command *c) {
     if (!c) return;
-    if (c->argv) {
-        for (size_t i = 0; c->argv[i]; i++)
-            free(c->argv[i]);
-        free(c->argv);
-    }
-    free(c->input_file);
-    free(c->output_file);
-    free(c->error_file);
+    free_strings(c->argv);
+    free_strings(c->assigns);
+    for (size_t i = 0; i < c->num_redirs; i++)
+        free(c->redirs[i].target);
+    free(c->redirs);
+    compound_release(c->compound);
+}
+
+Compound *compound_retain(Compound *c) {
+    if (c) c->refcount++;
+    return c;
 }
 
+void compound_release(Compound *c) {
+    if (!c || --c->refcount > 0) return;
+    free_job_list(&c->cond);
+    free_job_list(&c->body);
+    free_job_list(&c->else_part);
+    free(c->name);
+    free_strings(c->words);
+    for (size_t i = 0; i < c->num_items; i++) {
+        free_strings(c->items[i].patterns);
+        free_job_list(&c->items[i].body);
+    }
+    free(c->items);
+    free(c);
+}
 
 void free_job(Job *job) {
     if (!job) return;
@@ -270,157 +625,638 @@ void free_job_list(JobList *list) {
     list->count = 0;
 }
 
+static void job_list_push(JobList *list, Job *job) {
+    list->jobs = realloc(list->jobs, (list->count + 1) * sizeof *list->jobs);
+    list->jobs[list->count++] = job;
+}
 
-/* ---------- Parser ---------- */
-JobList parse_line(const char *line_in) {
-    JobList list  = {0}; // structure holding all parsed jobs
-    if (!line_in) return list;
+static void job_push_command(Job *job, Command cmd) {
+    job->commands = realloc(job->commands,
+        (job->num_cmds + 1) * sizeof *job->commands);
+    job->commands[job->num_cmds++] = cmd;
+}
 
-    // make a working copy of the input for modifications
-    char *buf = strdup(line_in);
-    if (!buf) {
-        perror("strdup");
-        return list;
-    }
-    strip_trailing_newline(buf);
 
-    // 1. tokenize the line
+/* ---------- Parser ----------
+ * Recursive descent over the token vector:
+ *   list     := { pipeline (';' | '&' | '\n' | '&&' | '||') }
+ *   pipeline := command { '|' command }
+ *   command  := if | while | until | for | case | { list } | ( list )
+ *             | funcdef | simple
+ * Compound commands keep their bodies as JobLists, so they are parsed
+ * once and executed straight from the tree.
+ */
+typedef struct {
+    const Alias *alias;
+    size_t end;         // first token after its substituted text
+} AliasUse;
+
+typedef struct {
     StrVec tokens;
-    tokenize_with_specials(buf, &tokens);
-    // no tokens if empty line
-    if (tokens.size == 0) {
-        sv_free(&tokens);
-        free(buf);
-        return list;
+    size_t pos;
+    int incomplete;     // ran out of tokens inside a construct
+    int error;          // syntax error already reported
+    AliasUse *aliases;  // substitutions in progress, innermost last
+    size_t num_aliases;
+    size_t alias_next;  // word after a value ending in a blank (SIZE_MAX: none)
+} Parser;
+
+static const char *peek(const Parser *ps) {
+    return ps->pos < ps->tokens.size ? ps->tokens.data[ps->pos] : NULL;
+}
+
+static int at(const Parser *ps, const char *t) {
+    const char *p = peek(ps);
+    return p && strcmp(p, t) == 0;
+}
+
+static int accept(Parser *ps, const char *t) {
+    if (!at(ps, t)) return 0;
+    ps->pos++;
+    return 1;
+}
+
+static void skip_newlines(Parser *ps) {
+    while (accept(ps, "\n")) {}
+}
+
+static void syntax_error(Parser *ps) {
+    if (ps->error || ps->incomplete) return;
+    const char *t = peek(ps);
+    if (!t) {
+        // end of input: the caller can supply more lines
+        ps->incomplete = 1;
+        return;
     }
+    fprintf(stderr, "syntax error near unexpected token `%s'\n",
+        strcmp(t, "\n") == 0 ? "newline" : t);
+    ps->error = 1;
+}
 
-    // 2. setup variables for the current job
-    Job *current_job = calloc(1, sizeof *current_job);
-    current_job->commands = NULL;
-    current_job->num_cmds = 0;
-    current_job->background = false;
-    current_job->sequential = false;
+static int expect(Parser *ps, const char *t) {
+    if (accept(ps, t)) return 1;
+    syntax_error(ps);
+    return 0;
+}
 
-    // temporary holders for the current command being built
-    StrVec argv;
-    sv_init(&argv);
+static int failed(const Parser *ps) {
+    return ps->error || ps->incomplete;
+}
 
-    char *input_file = NULL;
-    char *output_file = NULL;
-    char *error_file = NULL;
-
-    // 3. main token scan loop
-    for (size_t i = 0; i < tokens.size; i++) {
-        char *t = tokens.data[i];
-
-        // job separator (; and &)
-        if (strcmp(t, ";") == 0 || strcmp(t, "&") == 0) {
-            // flush any pending argv into a command
-            if (argv.size > 0) {
-                Command cmd = make_command_from_argv(&argv);
-                cmd.input_file  = input_file;
-                cmd.output_file = output_file;
-                cmd.error_file  = error_file;
-                input_file = output_file = error_file = NULL;
-
-                current_job->commands = realloc(
-                    current_job->commands, 
-                    (current_job->num_cmds + 1) * sizeof *current_job->commands);
-                current_job->commands[current_job->num_cmds++] = cmd;
-            }
-            sv_free(&argv);
-
-            // mark job type
-            current_job->background = (strcmp(t, "&") == 0);
-            current_job->sequential = (strcmp(t, ";") == 0);
-
-            // store this job in the list
-            list.jobs = realloc(list.jobs, (list.count + 1) *sizeof *list.jobs);
-            list.jobs[list.count++] = current_job;
-
-            // start a fresh job
-            current_job = calloc(1, sizeof *current_job);
-            current_job->commands = NULL;
-            current_job->num_cmds = 0;
-            current_job->background = false;
-            current_job->sequential = false;
-            continue;
+// Operators that end a simple command
+static int is_operator(const char *t) {
+    return strcmp(t, ";") == 0 || strcmp(t, "&") == 0 ||
+           strcmp(t, "|") == 0 || strcmp(t, "&&") == 0 ||
+           strcmp(t, "||") == 0 || strcmp(t, ";;") == 0 ||
+           strcmp(t, "(") == 0 || strcmp(t, ")") == 0 ||
+           strcmp(t, "\n") == 0;
+}
+
+// Reserved words that close a list when seen in command position
+static int is_list_terminator(const char *t) {
+    static const char *words[] = {
+        "then", "elif", "else", "fi", "do", "done", "esac", "}", ";;", ")",
+    };
+    for (size_t i = 0; i < sizeof words / sizeof *words; i++) {
+        if (strcmp(t, words[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static JobList parse_list(Parser *ps);
+static int parse_command(Parser *ps, Command *cmd);
+
+/* ---------- Alias substitution ----------
+ * The word at ps->pos is replaced by copies of the alias's tokens,
+ * which the parser then reads like any others. An alias whose text is
+ * still being read (pos before its end) is not substituted again, so
+ * "alias ls='ls -F'" and mutually recursive aliases terminate.
+ */
+static void splice_alias(Parser *ps, const Alias *a) {
+    StrVec *v = &ps->tokens;
+    size_t pos = ps->pos, n = a->num_tokens;
+    if (!sv_reserve(v, v->size + n)) return;
+    free(v->data[pos]);
+    memmove(v->data + pos + n, v->data + pos + 1, (v->size - pos - 1) * sizeof *v->data);
+    for (size_t i = 0; i < n; i++) v->data[pos + i] = strdup(a->tokens[i]);
+    v->size = v->size + n - 1;
+
+    // enclosing substitutions and a pending next word move with the text
+    for (size_t i = 0; i < ps->num_aliases; i++) {
+        if (ps->aliases[i].end > pos) ps->aliases[i].end += n - 1;
+    }
+    if (ps->alias_next != SIZE_MAX && ps->alias_next > pos) ps->alias_next += n - 1;
+    else if (ps->alias_next == pos) ps->alias_next = SIZE_MAX;
+
+    AliasUse *tmp = realloc(ps->aliases, (ps->num_aliases + 1) * sizeof *tmp);
+    if (!tmp) return;
+    ps->aliases = tmp;
+    ps->aliases[ps->num_aliases++] = (AliasUse){ a, pos + n };
+    if (a->blank) ps->alias_next = pos + n;
+}
+
+// Substitute the word at ps->pos if it names an alias not already in use
+static int try_alias(Parser *ps) {
+    const char *t = peek(ps);
+    const Alias *a = t ? alias_find(t) : NULL;
+    if (!a) return 0;
+
+    // substitutions whose text has been read are over
+    while (ps->num_aliases > 0 && ps->aliases[ps->num_aliases - 1].end <= ps->pos) {
+        ps->num_aliases--;
+    }
+    for (size_t i = 0; i < ps->num_aliases; i++) {
+        if (ps->aliases[i].alias == a) return 0;
+    }
+    splice_alias(ps, a);
+    return 1;
+}
+
+/* Decode a redirection token (see redirect_op_len) into kind and fd */
+static int decode_redirect(const char *t, RedirKind *kind, int *fd) {
+    if (redirect_op_len(t) != strlen(t) || !*t) return 0;
+    if (t[0] == '&') {
+        *kind = t[2] == '>' ? REDIR_APPEND_BOTH : REDIR_OUTPUT_BOTH;
+        *fd = STDOUT_FILENO;
+        return 1;
+    }
+    char *op;
+    long n = strtol(t, &op, 10);
+    int has_fd = op != t;
+    if (op[0] == '<' && op[1] == '<') {
+        *kind = op[2] == '<' ? REDIR_HERESTRING : REDIR_HEREDOC;
+        *fd = has_fd ? (int)n : STDIN_FILENO;
+    } else if (op[0] == '<') {
+        *kind = op[1] == '&' ? REDIR_DUP : REDIR_INPUT;
+        *fd = has_fd ? (int)n : STDIN_FILENO;
+    } else {
+        *kind = op[1] == '>' ? REDIR_APPEND
+              : op[1] == '&' ? REDIR_DUP : REDIR_OUTPUT;
+        *fd = has_fd ? (int)n : STDOUT_FILENO;
+    }
+    return 1;
+}
+
+/* Redirection operator and its target word. Returns 1 if one was consumed. */
+static int parse_redirect(Parser *ps, Command *cmd) {
+    const char *t = peek(ps);
+    Redirection r;
+    if (!t || !decode_redirect(t, &r.kind, &r.fd)) return 0;
+
+    ps->pos++;
+    const char *target = peek(ps);
+    RedirKind k;
+    int fd;
+    if (!target || is_operator(target) || decode_redirect(target, &k, &fd)) {
+        syntax_error(ps);
+        return 0;
+    }
+    r.target = strdup(target);
+    ps->pos++;
+
+    cmd->redirs = realloc(cmd->redirs, (cmd->num_redirs + 1) * sizeof *cmd->redirs);
+    cmd->redirs[cmd->num_redirs++] = r;
+    return 1;
+}
+
+static Compound *new_compound(void) {
+    Compound *c = calloc(1, sizeof *c);
+    c->refcount = 1;
+    return c;
+}
+
+/* if/elif tail: condition, "then" body, then elif/else/fi */
+static void parse_if_tail(Parser *ps, Compound *c) {
+    c->cond = parse_list(ps);
+    if (!expect(ps, "then")) return;
+    c->body = parse_list(ps);
+    if (failed(ps)) return;
+
+    if (accept(ps, "elif")) {
+        // elif is a nested if in the else branch
+        Compound *nested = new_compound();
+        Command cmd = make_empty_command();
+        cmd.kind = CMD_IF;
+        cmd.compound = nested;
+        Job *job = calloc(1, sizeof *job);
+        job_push_command(job, cmd);
+        job_list_push(&c->else_part, job);
+        parse_if_tail(ps, nested);
+        return;
+    }
+    if (accept(ps, "else")) {
+        c->else_part = parse_list(ps);
+    }
+    expect(ps, "fi");
+}
+
+static void parse_loop(Parser *ps, Compound *c) {
+    c->cond = parse_list(ps);
+    if (!expect(ps, "do")) return;
+    c->body = parse_list(ps);
+    expect(ps, "done");
+}
+
+/* for NAME [in WORD...] ; do LIST done */
+static void parse_for(Parser *ps, Compound *c) {
+    const char *name = peek(ps);
+    if (!name || !var_valid_name(name, strlen(name))) {
+        syntax_error(ps);
+        return;
+    }
+    c->name = strdup(name);
+    ps->pos++;
+    skip_newlines(ps);
+
+    if (accept(ps, "in")) {
+        c->has_in = true;
+        StrVec words;
+        sv_init(&words);
+        const char *t;
+        while ((t = peek(ps)) && !is_operator(t)) {
+            sv_push(&words, strdup(t));
+            ps->pos++;
+        }
+        c->words = take_strings(&words);
+        if (!accept(ps, ";") && !at(ps, "\n")) {
+            syntax_error(ps);
+            return;
         }
+    } else {
+        accept(ps, ";");
+    }
+    skip_newlines(ps);
+    if (!expect(ps, "do")) return;
+    c->body = parse_list(ps);
+    expect(ps, "done");
+}
 
-        // pipeline split (|)
-        if (strcmp(t, "|") == 0) {
-            Command cmd = make_command_from_argv(&argv);
-            cmd.input_file = input_file;
-            cmd.output_file = output_file;
-            cmd.error_file = error_file;
-            input_file = output_file = error_file = NULL;
-
-            current_job->commands = realloc(
-                current_job->commands,
-                (current_job->num_cmds +1) * sizeof *current_job->commands);
-            current_job->commands[current_job->num_cmds++] = cmd;
-
-            sv_free(&argv);
-            sv_init(&argv);
-            continue;
+/* case WORD in [(] PATTERN [| PATTERN]... ) LIST ;; ... esac */
+static void parse_case(Parser *ps, Compound *c) {
+    const char *word = peek(ps);
+    if (!word || is_operator(word)) {
+        syntax_error(ps);
+        return;
+    }
+    StrVec subject;
+    sv_init(&subject);
+    sv_push(&subject, strdup(word));
+    c->words = take_strings(&subject);
+    ps->pos++;
+    skip_newlines(ps);
+    if (!expect(ps, "in")) return;
+    skip_newlines(ps);
+
+    while (!accept(ps, "esac")) {
+        if (!peek(ps)) {
+            syntax_error(ps);
+            return;
+        }
+        accept(ps, "(");
+
+        StrVec pats;
+        sv_init(&pats);
+        for (;;) {
+            const char *t = peek(ps);
+            if (!t || is_operator(t)) break;
+            sv_push(&pats, strdup(t));
+            ps->pos++;
+            if (!accept(ps, "|")) break;
+        }
+        if (pats.size == 0 || !expect(ps, ")")) {
+            sv_free(&pats);
+            syntax_error(ps);
+            return;
         }
 
-        // redirections (<, >, 2>)
-        if (strcmp(t, "<") == 0 && i + 1 < tokens.size) {
-            free(input_file);
-            input_file = strdup(tokens.data[++i]);
+        c->items = realloc(c->items, (c->num_items + 1) * sizeof *c->items);
+        CaseItem *item = &c->items[c->num_items++];
+        item->patterns = take_strings(&pats);
+        item->body = parse_list(ps);
+        if (failed(ps)) return;
+
+        if (accept(ps, ";;")) {
+            skip_newlines(ps);
             continue;
         }
-        if (strcmp(t, ">") == 0 && i + 1 < tokens.size) {
-            free(output_file);
-            output_file = strdup(tokens.data[++i]);
+        expect(ps, "esac");
+        return;
+    }
+}
+
+/* { LIST } and ( LIST ) */
+static void parse_group(Parser *ps, Compound *c, const char *close) {
+    c->body = parse_list(ps);
+    expect(ps, close);
+}
+
+/* NAME ( ) { LIST } */
+static void parse_funcdef(Parser *ps, Compound *c) {
+    c->name = strdup(peek(ps));
+    ps->pos += 3; // name ( )
+    skip_newlines(ps);
+    if (!expect(ps, "{")) return;
+    c->body = parse_list(ps);
+    expect(ps, "}");
+}
+
+/* coproc [NAME] COMMAND: a NAME is only taken before a compound command,
+ * so "coproc cat -u" is the command cat under the name COPROC
+ */
+static void parse_coproc(Parser *ps, Compound *c) {
+    static const char *const compound_start[] = {
+        "{", "(", "if", "while", "until", "for", "case", NULL
+    };
+    const char *name = peek(ps);
+    const char *next = ps->pos + 1 < ps->tokens.size ? ps->tokens.data[ps->pos + 1] : NULL;
+    bool named = false;
+    for (size_t i = 0; next && compound_start[i]; i++) {
+        named |= strcmp(next, compound_start[i]) == 0;
+    }
+    if (named && var_valid_name(name, strlen(name))) {
+        c->name = strdup(name);
+        ps->pos++;
+    } else {
+        c->name = strdup("COPROC");
+    }
+
+    Command cmd;
+    parse_command(ps, &cmd);
+    Job *job = calloc(1, sizeof *job);
+    job_push_command(job, cmd);
+    job_list_push(&c->body, job);
+}
+
+static int is_funcdef_start(const Parser *ps) {
+    if (ps->pos + 2 >= ps->tokens.size) return 0;
+    const char *name = ps->tokens.data[ps->pos];
+    return strcmp(ps->tokens.data[ps->pos + 1], "(") == 0 &&
+           strcmp(ps->tokens.data[ps->pos + 2], ")") == 0 &&
+           var_valid_name(name, strlen(name));
+}
+
+/* Do words[0..n) form whole command prefixes (timeout [-s SIG] [-k T]
+ * DURATION, nice [-n N | -N | --adjustment=N], cpus LIST, limit SPEC), as the executor
+ * reads them? Only the shape is checked; values are checked when run.
+ */
+static int all_prefixes(char *const *words, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        const char *w = words[i++];
+        if (strcmp(w, "timeout") == 0) {
+            while (i < n && words[i][0] == '-') {
+                i += strcmp(words[i], "-s") == 0 || strcmp(words[i], "-k") == 0 ? 2 : 1;
+            }
+            i++;                            // DURATION
+        } else if (strcmp(w, "nice") == 0) {
+            if (i < n && (strcmp(words[i], "-n") == 0 ||
+                          strcmp(words[i], "--adjustment") == 0)) i += 2;
+            else if (i < n && words[i][0] == '-') i++;
+        } else if (strcmp(w, "cpus") == 0 || strcmp(w, "limit") == 0) {
+            i++;
+        } else {
+            return 0;
+        }
+    }
+    return n > 0 && i == n;
+}
+
+static int opens_compound(const char *t) {
+    return strcmp(t, "(") == 0 || strcmp(t, "{") == 0 || strcmp(t, "if") == 0 ||
+           strcmp(t, "while") == 0 || strcmp(t, "until") == 0 ||
+           strcmp(t, "for") == 0 || strcmp(t, "case") == 0;
+}
+
+/* `timeout 5 ( a | b )`: the compound command becomes cmd, keeping the
+ * words before it in argv as its prefixes
+ */
+static int parse_prefixed_compound(Parser *ps, Command *cmd) {
+    Command inner;
+    int ok = parse_command(ps, &inner);
+    cmd->kind = inner.kind;
+    cmd->compound = inner.compound;
+    for (size_t i = 0; i < inner.num_redirs; i++) {
+        cmd->redirs = realloc(cmd->redirs, (cmd->num_redirs + 1) * sizeof *cmd->redirs);
+        cmd->redirs[cmd->num_redirs++] = inner.redirs[i];
+    }
+    free(inner.redirs);
+    free_strings(inner.argv);
+    free_strings(inner.assigns);
+    return ok && !failed(ps);
+}
+
+/* Simple command: NAME=value words, arguments and redirections */
+static int parse_simple(Parser *ps, Command *cmd) {
+    StrVec argv;
+    sv_init(&argv);
+    StrVec assigns;     // leading NAME=value words
+    sv_init(&assigns);
+    int seen = 0;
+    int prefixed = 0;   // prefix words before a compound command
+
+    for (;;) {
+        const char *t = peek(ps);
+        if (t && opens_compound(t) && all_prefixes(argv.data, argv.size)) {
+            prefixed = 1;
+            break;
+        }
+        if (!t || is_operator(t)) break;
+        if (parse_redirect(ps, cmd)) {
+            seen = 1;
             continue;
         }
-        if (strcmp(t, "2>") == 0 && i + 1 < tokens.size) {
-            free(error_file);
-            error_file = strdup(tokens.data[++i]);
+        if (failed(ps)) break;
+
+        // the command word after assignments or redirections, or the
+        // word after an alias ending in a blank
+        if (((argv.size == 0 && !is_assignment_word(t)) || ps->pos == ps->alias_next) &&
+            try_alias(ps)) {
+            seen = 1;
             continue;
         }
 
-        // normal word argument
-        sv_push(&argv, strdup(t));
+        // variable assignments before the command name
+        if (argv.size == 0 && is_assignment_word(t)) {
+            sv_push(&assigns, strdup(t));
+        } else {
+            // normal word argument
+            sv_push(&argv, strdup(t));
+        }
+        seen = 1;
+        ps->pos++;
     }
 
-    // 4. finalize the last command and job
-    if (argv.size > 0) {
-        Command cmd = make_command_from_argv(&argv);
-        cmd.input_file = input_file;
-        cmd.output_file = output_file;
-        cmd.error_file = error_file;
-        input_file = output_file = error_file = NULL;
+    cmd->argv = take_strings(&argv);
+    if (assigns.size > 0) cmd->assigns = take_strings(&assigns);
+    else sv_free(&assigns);
+
+    if (prefixed) return parse_prefixed_compound(ps, cmd);
+    if (!seen && !failed(ps)) syntax_error(ps);
+    return !failed(ps);
+}
+
+// Words that open a compound command: recognized before aliases
+static int is_reserved(const char *t) {
+    return strcmp(t, "if") == 0 || strcmp(t, "while") == 0 ||
+           strcmp(t, "until") == 0 || strcmp(t, "for") == 0 ||
+           strcmp(t, "case") == 0 || strcmp(t, "{") == 0 ||
+           strcmp(t, "coproc") == 0;
+}
+
+static int parse_command(Parser *ps, Command *cmd) {
+    *cmd = make_empty_command();
+    const char *t = peek(ps);
 
-        current_job->commands = realloc(
-            current_job->commands,
-            (current_job->num_cmds + 1) * sizeof *current_job->commands);
-        current_job->commands[current_job->num_cmds++] = cmd;
+    // an alias may expand to a keyword, so substitute first
+    int aliased = 0;
+    while (t && !is_reserved(t) && !is_funcdef_start(ps) && try_alias(ps)) {
+        aliased = 1;
+        t = peek(ps);
+    }
+    if (aliased && (!t || (is_operator(t) && strcmp(t, "(") != 0))) {
+        // an alias with an empty value: an empty command
+        cmd->argv = calloc(1, sizeof *cmd->argv);
+        return 1;
     }
-    sv_free(&argv);
-    free(input_file);
-    free(output_file);
-    free(error_file);
 
-    if (current_job->num_cmds > 0) {
-        list.jobs = realloc(list.jobs, (list.count + 1) * sizeof *list.jobs);
-        list.jobs[list.count++] = current_job;
-    } else {
-        free(current_job);
+    if (!t) {
+        syntax_error(ps);
+        return 0;
     }
 
-    // 5. cleanup
-    sv_free(&tokens);
-    free(buf);
+    if (strcmp(t, "if") == 0) cmd->kind = CMD_IF;
+    else if (strcmp(t, "while") == 0) cmd->kind = CMD_WHILE;
+    else if (strcmp(t, "until") == 0) cmd->kind = CMD_UNTIL;
+    else if (strcmp(t, "for") == 0) cmd->kind = CMD_FOR;
+    else if (strcmp(t, "case") == 0) cmd->kind = CMD_CASE;
+    else if (strcmp(t, "{") == 0) cmd->kind = CMD_GROUP;
+    else if (strcmp(t, "(") == 0) cmd->kind = CMD_SUBSHELL;
+    else if (strcmp(t, "coproc") == 0) cmd->kind = CMD_COPROC;
+    else if (is_funcdef_start(ps)) cmd->kind = CMD_FUNCDEF;
+    else return parse_simple(ps, cmd);
+
+    cmd->compound = new_compound();
+    if (cmd->kind != CMD_FUNCDEF) ps->pos++; // keyword
 
+    switch (cmd->kind) {
+    case CMD_IF:      parse_if_tail(ps, cmd->compound); break;
+    case CMD_WHILE:
+    case CMD_UNTIL:   parse_loop(ps, cmd->compound); break;
+    case CMD_FOR:     parse_for(ps, cmd->compound); break;
+    case CMD_CASE:    parse_case(ps, cmd->compound); break;
+    case CMD_FUNCDEF: parse_funcdef(ps, cmd->compound); break;
+    case CMD_GROUP:   parse_group(ps, cmd->compound, "}"); break;
+    case CMD_SUBSHELL: parse_group(ps, cmd->compound, ")"); break;
+    case CMD_COPROC:  parse_coproc(ps, cmd->compound); break;
+    default: break;
+    }
+
+    // redirections after the closing keyword apply to the whole command
+    while (!failed(ps) && parse_redirect(ps, cmd)) {}
+    return !failed(ps);
+}
+
+static Job *parse_pipeline(Parser *ps) {
+    Job *job = calloc(1, sizeof *job);
+    for (;;) {
+        Command cmd;
+        int ok = parse_command(ps, &cmd);
+        job_push_command(job, cmd);
+        if (!ok) break;
+
+        // pipeline split (|)
+        if (!accept(ps, "|")) break;
+        skip_newlines(ps);
+    }
+    return job;
+}
+
+static JobList parse_list(Parser *ps) {
+    JobList list = {0};
+    for (;;) {
+        skip_newlines(ps);
+        const char *t = peek(ps);
+        if (!t || is_list_terminator(t)) break;
+
+        Job *job = parse_pipeline(ps);
+        job_list_push(&list, job);
+        if (failed(ps)) break;
+
+        // job separators (;, &, newline, &&, ||)
+        if (accept(ps, "&&")) {
+            job->and_if = true;
+        } else if (accept(ps, "||")) {
+            job->or_if = true;
+        } else if (accept(ps, "&")) {
+            job->background = true;
+            continue;
+        } else if (accept(ps, ";") || accept(ps, "\n")) {
+            job->sequential = true;
+            continue;
+        } else {
+            break;
+        }
+
+        // && and || need another pipeline
+        skip_newlines(ps);
+        if (!peek(ps)) {
+            ps->incomplete = 1;
+            break;
+        }
+    }
     return list;
 }
 
+JobList parse_line(const char *line_in) {
+    JobList list  = {0}; // structure holding all parsed jobs
+    if (!line_in) return list;
 
+    // make a working copy of the input for modifications
+    char *buf = strdup(line_in);
+    if (!buf) {
+        perror("strdup");
+        return list;
+    }
+    strip_trailing_newline(buf);
 
+    // 1. tokenize the line
+    Parser ps;
+    memset(&ps, 0, sizeof ps);
+    ps.alias_next = SIZE_MAX;
+    ps.incomplete = tokenize_with_specials(buf, &ps.tokens);
 
+    // 2. parse the token stream into jobs
+    if (!ps.incomplete) {
+        list = parse_list(&ps);
+        // anything left over (e.g. a stray "fi" or ")") is an error
+        if (!failed(&ps) && peek(&ps)) syntax_error(&ps);
+    }
 
+    // 3. an unfinished or invalid line yields no jobs
+    if (failed(&ps)) {
+        free_job_list(&list);
+    }
+    list.incomplete = ps.incomplete && !ps.error;
+    list.error = ps.error;
 
+    // 4. cleanup
+    sv_free(&ps.tokens);
+    free(ps.aliases);
+    free(buf);
 
+    return list;
+}
+
+char **parse_tokens(const char *text, size_t *count) {
+    char *buf = strdup(text);
+    if (!buf) return NULL;
+    StrVec tokens;
+    int incomplete = tokenize_with_specials(buf, &tokens);
+    free(buf);
+    if (incomplete) {
+        sv_free(&tokens);
+        return NULL;
+    }
+    *count = tokens.size;
+    return take_strings(&tokens);
+}
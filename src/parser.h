@@ -2,12 +2,18 @@
 #define PARSER_H
 #include "shelltypes.h"
 
-typedef struct Joblist {
-    Job **jobs;
-    size_t count;
-} JobList;
-
+/* Parse a line (possibly several lines joined with '\n') into jobs.
+* Sets list.incomplete when more input is needed to finish a construct,
+* and list.error after reporting a syntax error.
+*/
 JobList parse_line(const char *line);
 void free_job_list(JobList *list);
 
+// The tokens parse_line would see in text (NULL-terminated, *count of
+// them), or NULL if text leaves a quote or construct open
+char **parse_tokens(const char *text, size_t *count);
+
+Compound *compound_retain(Compound *c);
+void compound_release(Compound *c);
+
 #endif // PARSER_H
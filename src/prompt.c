@@ -0,0 +1,313 @@
+#include "prompt.h"
+#include "builtins.h"
+#include "vars.h"
+#include "dirs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern ShellState shell_state;
+
+/* ---------- Output buffer ---------- */
+static char *out = NULL;
+static size_t out_len = 0;
+static size_t out_cap = 0;
+
+static void out_str(const char *s, size_t n) {
+    if (out_len + n + 1 > out_cap) {
+        size_t cap = out_cap ? out_cap : 256;
+        while (cap < out_len + n + 1) cap *= 2;
+        char *tmp = realloc(out, cap);
+        if (!tmp) return;
+        out = tmp;
+        out_cap = cap;
+    }
+    memcpy(out + out_len, s, n);
+    out_len += n;
+    out[out_len] = '\0';
+}
+
+static void out_cstr(const char *s) {
+    out_str(s, strlen(s));
+}
+
+/* ---------- Memoized segments ---------- */
+static char user[64];
+static char host[64];
+
+static char git_dir[PATH_MAX];      // "" when cwd is not in a repo
+static bool git_dir_valid = false;  // git_dir is for the current cwd
+
+static char branch[128];
+static struct timespec head_mtime;  // HEAD as of the cached branch
+static ino_t head_ino = 0;
+
+void prompt_cwd_changed(void) {
+    git_dir_valid = false;
+}
+
+// the logical $PWD kept by cd: no getcwd per prompt
+static const char *get_cwd(void) {
+    return dirs_pwd();
+}
+
+static const char *get_user(void) {
+    if (!user[0]) {
+        struct passwd *pw = getpwuid(getuid());
+        snprintf(user, sizeof user, "%s", pw ? pw->pw_name : "?");
+    }
+    return user;
+}
+
+static const char *get_host(void) {
+    if (!host[0]) {
+        if (gethostname(host, sizeof host) < 0) strcpy(host, "?");
+        host[sizeof host - 1] = '\0';
+        char *dot = strchr(host, '.');
+        if (dot) *dot = '\0';
+    }
+    return host;
+}
+
+/* Find the git directory for cwd: the nearest .git going up, either a
+ * directory or a "gitdir: PATH" file (worktrees, submodules).
+ */
+static const char *get_git_dir(void) {
+    if (git_dir_valid) return git_dir;
+    git_dir_valid = true;
+    git_dir[0] = '\0';
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof dir, "%s", get_cwd());
+    for (;;) {
+        char path[PATH_MAX + 8];
+        snprintf(path, sizeof path, "%s/.git", strcmp(dir, "/") ? dir : "");
+        struct stat st;
+        if (stat(path, &st) == 0) {
+            int n = 0;
+            if (S_ISDIR(st.st_mode)) {
+                n = snprintf(git_dir, sizeof git_dir, "%s", path);
+            } else {
+                FILE *f = fopen(path, "r");
+                char line[PATH_MAX + 16];
+                if (f && fgets(line, sizeof line, f) && strncmp(line, "gitdir: ", 8) == 0) {
+                    line[strcspn(line, "\n")] = '\0';
+                    if (line[8] == '/') n = snprintf(git_dir, sizeof git_dir, "%s", line + 8);
+                    else n = snprintf(git_dir, sizeof git_dir, "%s/%s", dir, line + 8);
+                }
+                if (f) fclose(f);
+            }
+            if (n < 0 || (size_t)n >= sizeof git_dir) git_dir[0] = '\0';   // too long
+            break;
+        }
+        char *slash = strrchr(dir, '/');
+        if (!slash || slash == dir) {
+            if (strcmp(dir, "/") == 0) break;
+            strcpy(dir, "/");
+        } else {
+            *slash = '\0';
+        }
+    }
+    // a new repo: the cached branch belongs to another one
+    head_ino = 0;
+    return git_dir;
+}
+
+// Branch name, re-read only when HEAD's inode or mtime changes
+static const char *get_branch(void) {
+    const char *gd = get_git_dir();
+    if (!gd[0]) return "";
+
+    char path[PATH_MAX + 8];
+    snprintf(path, sizeof path, "%s/HEAD", gd);
+    struct stat st;
+    if (stat(path, &st) < 0) return "";
+    if (st.st_ino == head_ino && st.st_mtim.tv_sec == head_mtime.tv_sec &&
+        st.st_mtim.tv_nsec == head_mtime.tv_nsec) {
+        return branch;
+    }
+
+    branch[0] = '\0';
+    FILE *f = fopen(path, "r");
+    char line[256];
+    if (f && fgets(line, sizeof line, f)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "ref: refs/heads/", 16) == 0) {
+            snprintf(branch, sizeof branch, "%s", line + 16);
+        } else {
+            snprintf(branch, sizeof branch, "%.7s", line);    // detached
+        }
+    }
+    if (f) fclose(f);
+    head_ino = st.st_ino;
+    head_mtime = st.st_mtim;
+    return branch;
+}
+
+/* ---------- Async segment: git dirty state ---------- */
+static pid_t helper_pid = -1;
+static int helper_fd = -1;
+static char helper_repo[PATH_MAX];  // repo the running helper checks
+static char dirty_repo[PATH_MAX];   // repo the dirty mark belongs to
+static char dirty_mark[2];          // "*", or "" for clean / not known yet
+static const char *last_template = NULL;
+
+// Start `git diff --quiet HEAD` unless one is already running
+static void start_dirty_check(const char *gd) {
+    if (strcmp(dirty_repo, gd) != 0) {
+        snprintf(dirty_repo, sizeof dirty_repo, "%s", gd);
+        dirty_mark[0] = '\0';
+    }
+    if (helper_pid > 0) return;
+
+    int pfd[2];
+    if (pipe2(pfd, O_CLOEXEC) < 0) return;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pfd[0]);
+        close(pfd[1]);
+        return;
+    }
+    if (pid == 0) {
+        // the pipe's write end stays open (no cloexec) until git exits
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        fcntl(pfd[1], F_SETFD, 0);
+        close(pfd[0]);
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0) {
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        execlp("git", "git", "diff", "--quiet", "HEAD", "--", (char *)NULL);
+        _exit(2);
+    }
+    close(pfd[1]);
+    helper_pid = pid;
+    helper_fd = pfd[0];
+    snprintf(helper_repo, sizeof helper_repo, "%s", gd);
+}
+
+int prompt_async_fd(void) {
+    return helper_fd;
+}
+
+bool prompt_async_finish(void) {
+    if (helper_fd < 0) return false;
+    char c;
+    ssize_t n = read(helper_fd, &c, 1);
+    if (n < 0 && errno == EINTR) return false;
+    close(helper_fd);
+    helper_fd = -1;
+
+    int status = 0;
+    while (waitpid(helper_pid, &status, 0) < 0 && errno == EINTR) {}
+    helper_pid = -1;
+
+    // exit 1: differences; anything else but 0 leaves the mark unknown
+    if (!WIFEXITED(status) || WEXITSTATUS(status) > 1) return false;
+    if (strcmp(helper_repo, dirty_repo) != 0) return false;    // cd'd away
+    const char *mark = WEXITSTATUS(status) == 1 ? "*" : "";
+    if (strcmp(mark, dirty_mark) == 0) return false;
+    strcpy(dirty_mark, mark);
+    return true;
+}
+
+bool prompt_reap(pid_t pid) {
+    if (pid <= 0 || pid != helper_pid) return false;
+    if (helper_fd >= 0) close(helper_fd);
+    helper_fd = -1;
+    helper_pid = -1;
+    return true;
+}
+
+/* ---------- Rendering ---------- */
+
+// \w: cwd with $HOME shown as ~
+static void out_cwd(bool last_part) {
+    const char *c = get_cwd();
+    if (last_part) {
+        const char *slash = strrchr(c, '/');
+        out_cstr(slash && slash[1] ? slash + 1 : c);
+        return;
+    }
+    const char *home = var_get("HOME");
+    size_t hl = home ? strlen(home) : 0;
+    if (hl > 1 && strncmp(c, home, hl) == 0 && (c[hl] == '/' || c[hl] == '\0')) {
+        out_str("~", 1);
+        c += hl;
+    }
+    out_cstr(c);
+}
+
+// Expand template; start_async starts helpers for async segments
+static const char *render(const char *template, bool start_async) {
+    out_len = 0;
+    out_str("", 0);
+
+    char num[32];
+    for (const char *p = template; *p; p++) {
+        if (*p != '\\' || !p[1]) {
+            out_str(p, 1);
+            continue;
+        }
+        switch (*++p) {
+        case 'w': out_cwd(false); break;
+        case 'W': out_cwd(true); break;
+        case 'u': out_cstr(get_user()); break;
+        case 'h': out_cstr(get_host()); break;
+        case '?':
+            snprintf(num, sizeof num, "%d", shell_state.last_status);
+            out_cstr(num);
+            break;
+        case 'j':
+            snprintf(num, sizeof num, "%zu", shell_state.bg_jobs);
+            out_cstr(num);
+            break;
+        case 't': {
+            time_t now = time(NULL);
+            struct tm tm;
+            localtime_r(&now, &tm);
+            strftime(num, sizeof num, "%H:%M:%S", &tm);
+            out_cstr(num);
+            break;
+        }
+        case 'g': out_cstr(get_branch()); break;
+        case 'G': {
+            const char *gd = get_git_dir();
+            if (!gd[0]) break;
+            if (start_async) start_dirty_check(gd);
+            out_cstr(dirty_mark);
+            break;
+        }
+        case '$': out_str(geteuid() == 0 ? "#" : "$", 1); break;
+        case 'n': out_str("\n", 1); break;
+        case 'e': out_str("\033", 1); break;
+        case '\\': out_str("\\", 1); break;
+        default:
+            out_str(p - 1, 2);
+            break;
+        }
+    }
+    return out;
+}
+
+const char *prompt_render(const char *template) {
+    last_template = template;
+    return render(template, true);
+}
+
+const char *prompt_rerender(void) {
+    return render(last_template ? last_template : "", false);
+}
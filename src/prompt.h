@@ -0,0 +1,37 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Prompt escapes, expanded each time the prompt is shown:
+*   \w cwd (~ for $HOME)   \W last part of cwd   \u user   \h host
+*   \? last exit status    \t time HH:MM:SS      \j background processes
+*   \g git branch          \G git dirty mark (*) \$ '#' for root, else '$'
+*   \n newline             \e escape (colours)   \\ backslash
+* Cheap segments are memoized: cwd is the $PWD kept by cd, user and host
+* for good, the git branch until .git/HEAD changes. \G is slow in big
+* repos, so it runs `git diff --quiet HEAD` in a helper process: the
+* prompt shows the last known state at once, and the line editor
+* repaints it when the helper reports.
+*/
+
+// Expand template; the result stays valid until the next call
+const char *prompt_render(const char *template);
+
+// Expand the last template again (after an async segment updated)
+const char *prompt_rerender(void);
+
+// cd changed the working directory
+void prompt_cwd_changed(void);
+
+// Read end of the running helper's pipe, or -1 if none is running
+int prompt_async_fd(void);
+
+// The helper's fd is readable: collect it. True if the prompt changed.
+bool prompt_async_finish(void);
+
+// For the child reaper: true if pid was the prompt helper (now reaped)
+bool prompt_reap(pid_t pid);
+
+#endif // PROMPT_H
@@ -0,0 +1,465 @@
+#include "rcfile.h"
+#include "parser.h"
+#include "vars.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAP_MAGIC   0x6d797263u    // "myrc"
+#define SNAP_VERSION 2u             // bump when the tree or encoding changes
+#define SNAP_NULL    UINT32_MAX     // length of a NULL string or vector
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;                  // rc file key: size, inode, mtime, hash
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t hash;
+    uint64_t payload;               // bytes of tree after the header
+} SnapHeader;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static uint64_t fnv1a(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3u;
+    }
+    return h;
+}
+
+const char *rc_path(void) {
+    static char path[PATH_MAX];
+    const char *env = var_get("MYSHELL_RC");
+    if (env && *env) return env;
+    const char *home = var_get("HOME");
+    if (!home) return NULL;
+    snprintf(path, sizeof path, "%s/.myshellrc", home);
+    return path;
+}
+
+void rc_free(JobList *list) {
+    if (!list) return;
+    free_job_list(list);
+    free(list);
+}
+
+/* ---------- Encoding ----------
+ * Integers are native-endian u32, flags one byte each; a string is its
+ * length and bytes (no terminator), a vector its count and strings.
+ */
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+} Buf;
+
+static void put(Buf *b, const void *p, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        b->data = realloc(b->data, cap);
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void put_u8(Buf *b, unsigned v) {
+    unsigned char c = (unsigned char)v;
+    put(b, &c, 1);
+}
+
+static void put_u32(Buf *b, size_t v) {
+    uint32_t x = (uint32_t)v;
+    put(b, &x, sizeof x);
+}
+
+static void put_str(Buf *b, const char *s) {
+    if (!s) {
+        put_u32(b, SNAP_NULL);
+        return;
+    }
+    size_t len = strlen(s);
+    put_u32(b, len);
+    put(b, s, len);
+}
+
+static void put_strv(Buf *b, char *const *v) {
+    if (!v) {
+        put_u32(b, SNAP_NULL);
+        return;
+    }
+    size_t n = 0;
+    while (v[n]) n++;
+    put_u32(b, n);
+    for (size_t i = 0; i < n; i++) put_str(b, v[i]);
+}
+
+static void put_list(Buf *b, const JobList *list);
+
+static void put_compound(Buf *b, const Compound *c) {
+    put_list(b, &c->cond);
+    put_list(b, &c->body);
+    put_list(b, &c->else_part);
+    put_str(b, c->name);
+    put_strv(b, c->words);
+    put_u8(b, c->has_in);
+    put_u32(b, c->num_items);
+    for (size_t i = 0; i < c->num_items; i++) {
+        put_strv(b, c->items[i].patterns);
+        put_list(b, &c->items[i].body);
+    }
+}
+
+static void put_command(Buf *b, const Command *c) {
+    put_u8(b, c->kind);
+    put_strv(b, c->argv);
+    put_strv(b, c->assigns);
+    put_u32(b, c->num_redirs);
+    for (size_t i = 0; i < c->num_redirs; i++) {
+        put_u8(b, c->redirs[i].kind);
+        put_u32(b, (size_t)(uint32_t)c->redirs[i].fd);
+        put_str(b, c->redirs[i].target);
+    }
+    put_u8(b, c->compound != NULL);
+    if (c->compound) put_compound(b, c->compound);
+}
+
+static void put_list(Buf *b, const JobList *list) {
+    put_u32(b, list->count);
+    for (size_t i = 0; i < list->count; i++) {
+        const Job *job = list->jobs[i];
+        put_u8(b, (unsigned)job->background | (unsigned)job->sequential << 1 |
+                  (unsigned)job->and_if << 2 | (unsigned)job->or_if << 3);
+        put_u32(b, job->num_cmds);
+        for (size_t k = 0; k < job->num_cmds; k++) put_command(b, &job->commands[k]);
+    }
+}
+
+/* ---------- Decoding ----------
+ * Every read is bounds checked; on a bad byte the reader stops and the
+ * partial tree (built with calloc, counts kept in step) is freed.
+ */
+typedef struct {
+    const unsigned char *p, *end;
+    bool bad;
+} Reader;
+
+static bool get(Reader *r, void *out, size_t n) {
+    if (r->bad || (size_t)(r->end - r->p) < n) {
+        r->bad = true;
+        return false;
+    }
+    memcpy(out, r->p, n);
+    r->p += n;
+    return true;
+}
+
+static unsigned get_u8(Reader *r) {
+    unsigned char c = 0;
+    get(r, &c, 1);
+    return c;
+}
+
+static uint32_t get_u32(Reader *r) {
+    uint32_t x = 0;
+    get(r, &x, sizeof x);
+    return x;
+}
+
+// A count of n items needs at least n more bytes; never SNAP_NULL
+static size_t get_count(Reader *r) {
+    uint32_t n = get_u32(r);
+    if (n == SNAP_NULL || n > (size_t)(r->end - r->p)) r->bad = true;
+    return r->bad ? 0 : n;
+}
+
+// calloc, or mark the snapshot bad
+static void *get_alloc(Reader *r, size_t n, size_t size) {
+    void *p = r->bad ? NULL : calloc(n ? n : 1, size);
+    if (!p) r->bad = true;
+    return p;
+}
+
+static char *get_str(Reader *r) {
+    uint32_t len = get_u32(r);
+    if (r->bad || len == SNAP_NULL) return NULL;
+    char *s = malloc((size_t)len + 1);
+    if (!s || !get(r, s, len)) {
+        free(s);
+        return NULL;
+    }
+    s[len] = '\0';
+    return s;
+}
+
+static char **get_strv(Reader *r) {
+    uint32_t n = get_u32(r);
+    if (r->bad || n == SNAP_NULL) return NULL;
+    if (n > (size_t)(r->end - r->p)) {
+        r->bad = true;
+        return NULL;
+    }
+    char **v = get_alloc(r, (size_t)n + 1, sizeof *v);
+    for (size_t i = 0; v && i < n && !r->bad; i++) {
+        v[i] = get_str(r);
+        if (!v[i]) r->bad = true;
+    }
+    return v;
+}
+
+static void get_list(Reader *r, JobList *list);
+
+static Compound *get_compound(Reader *r) {
+    Compound *c = get_alloc(r, 1, sizeof *c);
+    if (!c) return NULL;
+    c->refcount = 1;
+    get_list(r, &c->cond);
+    get_list(r, &c->body);
+    get_list(r, &c->else_part);
+    c->name = get_str(r);
+    c->words = get_strv(r);
+    c->has_in = get_u8(r) != 0;
+    size_t n = get_count(r);
+    c->items = get_alloc(r, n, sizeof *c->items);
+    for (size_t i = 0; c->items && i < n && !r->bad; i++) {
+        CaseItem *item = &c->items[c->num_items++];
+        item->patterns = get_strv(r);
+        get_list(r, &item->body);
+    }
+    return c;
+}
+
+/* Fields the executor relies on without checking: a tree that lacks one
+ * would crash the shell, so the snapshot is rejected and the text parsed.
+ */
+static bool well_formed(const Command *c) {
+    for (size_t i = 0; i < c->num_redirs; i++) {
+        if (!c->redirs[i].target) return false;
+    }
+    if (c->kind == CMD_SIMPLE) return c->argv != NULL;
+    const Compound *cc = c->compound;
+    if (!cc) return false;
+    switch (c->kind) {
+    case CMD_FOR:
+        return cc->name && (!cc->has_in || cc->words);
+    case CMD_FUNCDEF:
+    case CMD_COPROC:
+        return cc->name != NULL;
+    case CMD_CASE:
+        if (!cc->words || !cc->words[0]) return false;
+        for (size_t i = 0; i < cc->num_items; i++) {
+            if (!cc->items[i].patterns) return false;
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+static void get_command(Reader *r, Command *c) {
+    unsigned kind = get_u8(r);
+    if (kind > CMD_COPROC) r->bad = true;
+    c->kind = (CommandKind)kind;
+    c->argv = get_strv(r);
+    c->assigns = get_strv(r);
+    size_t n = get_count(r);
+    c->redirs = get_alloc(r, n, sizeof *c->redirs);
+    for (size_t i = 0; c->redirs && i < n && !r->bad; i++) {
+        Redirection *redir = &c->redirs[c->num_redirs++];
+        unsigned rk = get_u8(r);
+        if (rk > REDIR_HERESTRING) r->bad = true;
+        redir->kind = (RedirKind)rk;
+        redir->fd = (int)get_u32(r);
+        redir->target = get_str(r);
+    }
+    if (get_u8(r)) c->compound = get_compound(r);
+    if (!r->bad && !well_formed(c)) r->bad = true;
+}
+
+static void get_list(Reader *r, JobList *list) {
+    size_t n = get_count(r);
+    if (r->bad || n == 0) return;
+    list->jobs = get_alloc(r, n, sizeof *list->jobs);
+    for (size_t i = 0; list->jobs && i < n && !r->bad; i++) {
+        Job *job = get_alloc(r, 1, sizeof *job);
+        if (!job) break;
+        list->jobs[list->count++] = job;
+        unsigned flags = get_u8(r);
+        job->background = flags & 1;
+        job->sequential = flags & 2;
+        job->and_if = flags & 4;
+        job->or_if = flags & 8;
+        size_t k = get_count(r);
+        job->commands = get_alloc(r, k, sizeof *job->commands);
+        for (size_t j = 0; job->commands && j < k && !r->bad; j++) {
+            get_command(r, &job->commands[job->num_cmds++]);
+        }
+    }
+}
+
+/* ---------- Snapshot file ---------- */
+
+static JobList *decode(const unsigned char *data, size_t len) {
+    Reader r = { data, data + len, false };
+    JobList *list = calloc(1, sizeof *list);
+    get_list(&r, list);
+    if (r.bad || r.p != r.end) {
+        rc_free(list);
+        return NULL;
+    }
+    return list;
+}
+
+static void set_key(SnapHeader *h, const struct stat *st, uint64_t hash) {
+    h->size = (uint64_t)st->st_size;
+    h->ino = (uint64_t)st->st_ino;
+    h->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    h->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    h->hash = hash;
+}
+
+static bool key_matches(const SnapHeader *h, const struct stat *st) {
+    return h->size == (uint64_t)st->st_size && h->ino == (uint64_t)st->st_ino &&
+           h->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+           h->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+// Map the snapshot; NULL if missing or not one of ours
+static const SnapHeader *map_snapshot(const char *file, size_t *len) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *mem = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SnapHeader)) {
+        mem = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mem == MAP_FAILED) return NULL;
+
+    const SnapHeader *h = mem;
+    *len = (size_t)st.st_size;
+    if (h->magic != SNAP_MAGIC || h->version != SNAP_VERSION ||
+        h->payload != *len - sizeof *h) {
+        munmap(mem, *len);
+        return NULL;
+    }
+    return h;
+}
+
+// Write header and tree to a temporary file and rename it into place
+static void save_snapshot(const char *file, const struct stat *st, uint64_t hash,
+                          const JobList *list) {
+    Buf b = { NULL, 0, 0 };
+    SnapHeader h = { SNAP_MAGIC, SNAP_VERSION, 0, 0, 0, 0, 0, 0 };
+    put(&b, &h, sizeof h);
+    put_list(&b, list);
+    SnapHeader *hdr = (SnapHeader *)(void *)b.data;
+    set_key(hdr, st, hash);
+    hdr->payload = b.len - sizeof h;
+
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof tmp, "%s.%d", file, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        ssize_t w = write(fd, b.data, b.len);
+        if (close(fd) != 0 || w != (ssize_t)b.len || rename(tmp, file) != 0) {
+            unlink(tmp);
+        }
+    }
+    free(b.data);
+}
+
+static char *read_file(int fd, size_t size, size_t *len) {
+    char *text = malloc(size + 1);
+    size_t got = 0;
+    while (text && got < size) {
+        ssize_t n = read(fd, text + got, size - got);
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    if (text) text[got] = '\0';
+    *len = got;
+    return text;
+}
+
+JobList *rc_load(const char *path, RcStats *stats) {
+    *stats = (RcStats){ RC_NONE, 0, 0, false, 0 };
+    double start = now_ms();
+    struct stat st;
+    if (!path || stat(path, &st) < 0 || !S_ISREG(st.st_mode)) return NULL;
+    stats->bytes = (size_t)st.st_size;
+
+    char snap[PATH_MAX + 8];
+    snprintf(snap, sizeof snap, "%s.snap", path);
+    size_t map_len = 0;
+    const SnapHeader *h = map_snapshot(snap, &map_len);
+    const unsigned char *tree = (const unsigned char *)(h + 1);
+
+    // warm start: the rc file is as it was when the snapshot was taken
+    JobList *list = NULL;
+    if (h && key_matches(h, &st)) {
+        list = decode(tree, (size_t)h->payload);
+        stats->source = RC_SNAPSHOT;
+    }
+
+    if (!list) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            if (fd >= 0) close(fd);
+            if (h) munmap((void *)(uintptr_t)h, map_len);
+            return NULL;
+        }
+        size_t len = 0;
+        char *text = read_file(fd, (size_t)st.st_size, &len);
+        close(fd);
+        uint64_t hash = fnv1a(text, len);
+
+        // touched but unchanged: keep the tree, refresh the key
+        if (h && h->hash == hash && h->size == len) {
+            list = decode(tree, (size_t)h->payload);
+            SnapHeader fresh = *h;
+            set_key(&fresh, &st, hash);
+            int sfd = list ? open(snap, O_WRONLY | O_CLOEXEC) : -1;
+            if (sfd >= 0) {
+                if (pwrite(sfd, &fresh, sizeof fresh, 0) != (ssize_t)sizeof fresh) {
+                    unlink(snap);
+                }
+                close(sfd);
+            }
+            stats->source = RC_REHASHED;
+        }
+
+        if (!list) {
+            list = malloc(sizeof *list);
+            *list = parse_line(text);
+            stats->source = RC_PARSED;
+            stats->load_ms = now_ms() - start;
+            if (!list->error && !list->incomplete) {
+                double t = now_ms();
+                save_snapshot(snap, &st, hash, list);
+                stats->saved = true;
+                stats->save_ms = now_ms() - t;
+            }
+        }
+        free(text);
+    }
+    if (h) munmap((void *)(uintptr_t)h, map_len);
+    if (stats->source != RC_PARSED) stats->load_ms = now_ms() - start;
+    return list;
+}
@@ -0,0 +1,41 @@
+#ifndef RCFILE_H
+#define RCFILE_H
+
+#include "shelltypes.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Startup file: $MYSHELL_RC, default ~/.myshellrc (interactive shells).
+* Its parsed tree is cached in a binary snapshot, FILE.snap: a header
+* keyed by the rc file's size, mtime and FNV-1a hash, then the JobList
+* flattened into a byte stream. A warm start only stats the rc file,
+* maps the snapshot and rebuilds the tree from it: no read, tokenizer or
+* parser. When the mtime changed but the hash did not (touch, checkout),
+* the snapshot is kept and its header refreshed. A snapshot that fails
+* any check is ignored and rewritten.
+*/
+
+typedef enum {
+    RC_NONE,                // no rc file
+    RC_SNAPSHOT,            // tree from the snapshot, keyed by mtime
+    RC_REHASHED,            // mtime changed, hash matched: snapshot reused
+    RC_PARSED               // parsed from source
+} RcSource;
+
+typedef struct {
+    RcSource source;
+    size_t bytes;           // size of the rc file
+    double load_ms;         // validate and decode, or read and parse
+    bool saved;             // a fresh snapshot was written
+    double save_ms;         // ... taking this long
+} RcStats;
+
+// Path of the rc file, or NULL without $HOME
+const char *rc_path(void);
+
+// Parsed rc file (NULL if there is none); free with rc_free()
+JobList *rc_load(const char *path, RcStats *stats);
+void rc_free(JobList *list);
+
+#endif // RCFILE_H
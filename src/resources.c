@@ -0,0 +1,271 @@
+#include "resources.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+/* ---------- Resource table ----------
+ * unit is what ulimit counts in; limit= takes bytes for unit > 1.
+ */
+typedef struct {
+    char opt;               // ulimit option letter
+    const char *key;        // limit KEY=
+    int resource;
+    rlim_t unit;
+    const char *desc;
+} ResLimit;
+
+static const ResLimit res_limits[] = {
+    { 'c', "core",  RLIMIT_CORE,    512,  "core file size (blocks)" },
+    { 'd', "data",  RLIMIT_DATA,    1024, "data seg size (kbytes)" },
+    { 'f', "fsize", RLIMIT_FSIZE,   512,  "file size (blocks)" },
+    { 'l', "lock",  RLIMIT_MEMLOCK, 1024, "max locked memory (kbytes)" },
+    { 'n', "files", RLIMIT_NOFILE,  1,    "open files" },
+    { 's', "stack", RLIMIT_STACK,   1024, "stack size (kbytes)" },
+    { 't', "cpu",   RLIMIT_CPU,     1,    "cpu time (seconds)" },
+    { 'u', "procs", RLIMIT_NPROC,   1,    "max user processes" },
+    { 'v', "mem",   RLIMIT_AS,      1024, "virtual memory (kbytes)" },
+};
+#define NUM_LIMITS (sizeof res_limits / sizeof *res_limits)
+
+static const ResLimit *find_limit(const char *key, size_t len, char opt) {
+    for (size_t i = 0; i < NUM_LIMITS; i++) {
+        const ResLimit *l = &res_limits[i];
+        if (key ? strlen(l->key) == len && strncmp(l->key, key, len) == 0 : l->opt == opt) {
+            return l;
+        }
+    }
+    return NULL;
+}
+
+// "unlimited", or a number times mult, with K/M/G/T when suffixes is set
+static bool parse_value(const char *s, rlim_t mult, bool suffixes, rlim_t *out) {
+    if (strcmp(s, "unlimited") == 0) {
+        *out = RLIM_INFINITY;
+        return true;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s || errno || s[0] == '-') return false;
+    int shift = 0;
+    if (suffixes) {
+        switch (toupper((unsigned char)*end)) {
+        case 'K': shift = 10; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'G': shift = 30; end++; break;
+        case 'T': shift = 40; end++; break;
+        default: break;
+        }
+    }
+    if (*end != '\0' || v > (UINT64_MAX >> shift)) return false;
+    v <<= shift;
+    if (mult > 1 && v > UINT64_MAX / mult) return false;
+    v *= mult;
+    if (v >= RLIM_INFINITY) return false;   // would read as "unlimited"
+    *out = (rlim_t)v;
+    return true;
+}
+
+/* ---------- Prefixes ---------- */
+
+void res_init(ResourceSpec *spec) {
+    spec->set_nice = false;
+    spec->nice = 0;
+    spec->set_cpus = false;
+    CPU_ZERO(&spec->cpus);
+    spec->num_limits = 0;
+}
+
+// 0-3,6,8-9
+static bool parse_cpu_list(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10);
+        long hi = lo;
+        if (end == s || lo < 0) return false;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo) return false;
+        }
+        if (hi >= CPU_SETSIZE) return false;
+        for (long c = lo; c <= hi; c++) CPU_SET((size_t)c, set);
+        if (*end == ',') end++;
+        else if (*end) return false;
+        s = end;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+// KEY=VAL[,KEY=VAL...]
+static bool parse_limits(const char *s, ResourceSpec *spec) {
+    char *copy = strdup(s);
+    bool ok = copy != NULL;
+    for (char *save = NULL, *item = strtok_r(copy, ",", &save); ok && item;
+         item = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(item, '=');
+        const ResLimit *l = eq ? find_limit(item, (size_t)(eq - item), 0) : NULL;
+        rlim_t v;
+        if (!l || !parse_value(eq + 1, 1, l->unit > 1, &v) ||
+            spec->num_limits == RES_MAX_LIMITS) {
+            fprintf(stderr, "limit: invalid limit '%s'\n", item);
+            ok = false;
+            break;
+        }
+        spec->limits[spec->num_limits].resource = l->resource;
+        spec->limits[spec->num_limits++].value = v;
+    }
+    free(copy);
+    return ok;
+}
+
+/* nice's options: -n N, -nN, -N, --N (negative), --adjustment=N and
+ * --adjustment N. Returns the words taken including "nice", 0 for a
+ * form to leave to nice(1) (--help, ...), -1 after an error.
+ */
+static int nice_adjustment(char **argv, long *n) {
+    const char *a = argv[1], *val = NULL;
+    int used = 2;
+    if (!a || a[0] != '-') return 1;
+    if (strcmp(a, "-n") == 0 || strcmp(a, "--adjustment") == 0) {
+        val = argv[2];
+        used = 3;
+    } else if (strncmp(a, "-n", 2) == 0) {
+        val = a + 2;
+    } else if (strncmp(a, "--adjustment=", 13) == 0) {
+        val = a + 13;
+    } else if (isdigit((unsigned char)a[1]) ||
+               (a[1] == '-' && isdigit((unsigned char)a[2]))) {
+        val = a + 1;                // -5 is +5, --5 is -5
+    }
+    if (!val) return 0;
+    char *end;
+    errno = 0;
+    *n = strtol(val, &end, 10);
+    if (*end || end == val || errno || *n < -40 || *n > 40) {
+        fprintf(stderr, "nice: invalid adjustment '%s'\n", val);
+        return -1;
+    }
+    return used;
+}
+
+int res_parse_prefix(char **argv, ResourceSpec *spec) {
+    int used;
+    if (strcmp(argv[0], "nice") == 0) {
+        long n = 10;
+        used = nice_adjustment(argv, &n);
+        if (used <= 0) return used;
+        spec->set_nice = true;
+        spec->nice += (int)n;      // nested nice prefixes add up
+    } else if (strcmp(argv[0], "cpus") == 0) {
+        if (!argv[1] || !parse_cpu_list(argv[1], &spec->cpus)) {
+            fprintf(stderr, "cpus: invalid CPU list '%s'\n", argv[1] ? argv[1] : "");
+            return -1;
+        }
+        spec->set_cpus = true;
+        used = 2;
+    } else if (strcmp(argv[0], "limit") == 0) {
+        if (!argv[1] || !parse_limits(argv[1], spec)) {
+            if (!argv[1]) fprintf(stderr, "usage: limit KEY=VALUE[,...] command\n");
+            return -1;
+        }
+        used = 2;
+    } else {
+        return 0;
+    }
+    return used;
+}
+
+bool res_apply(const ResourceSpec *spec) {
+    if (spec->set_nice) {
+        // like nice(1): a refused increase in priority is only a warning
+        errno = 0;
+        int cur = getpriority(PRIO_PROCESS, 0);
+        if (errno == 0 && setpriority(PRIO_PROCESS, 0, cur + spec->nice) < 0) {
+            perror("nice: cannot set niceness");
+        }
+    }
+    if (spec->set_cpus && sched_setaffinity(0, sizeof spec->cpus, &spec->cpus) < 0) {
+        perror("cpus");
+        return false;
+    }
+    for (size_t i = 0; i < spec->num_limits; i++) {
+        struct rlimit rl = { spec->limits[i].value, spec->limits[i].value };
+        if (setrlimit(spec->limits[i].resource, &rl) < 0) {
+            perror("limit");
+            return false;
+        }
+    }
+    return true;
+}
+
+/* ---------- ulimit ---------- */
+
+static void print_limit(const ResLimit *l, bool hard, bool label) {
+    struct rlimit rl;
+    if (getrlimit(l->resource, &rl) < 0) {
+        perror("ulimit");
+        return;
+    }
+    rlim_t v = hard ? rl.rlim_max : rl.rlim_cur;
+    if (label) printf("%-28s (-%c) ", l->desc, l->opt);
+    if (v == RLIM_INFINITY) puts("unlimited");
+    else printf("%llu\n", (unsigned long long)(v / l->unit));
+}
+
+int res_ulimit(char **argv) {
+    bool soft = false, hard = false, all = false;
+    const ResLimit *l = NULL;
+    size_t i = 1;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; i++) {
+        for (const char *p = argv[i] + 1; *p; p++) {
+            if (*p == 'S') soft = true;
+            else if (*p == 'H') hard = true;
+            else if (*p == 'a') all = true;
+            else if (!(l = find_limit(NULL, 0, *p))) {
+                fprintf(stderr, "ulimit: -%c: invalid option\n"
+                        "usage: ulimit [-SHa] [-cdflnstuv] [limit]\n", *p);
+                return 2;
+            }
+        }
+    }
+    if (!l) l = find_limit(NULL, 0, 'f');
+
+    if (all) {
+        for (size_t k = 0; k < NUM_LIMITS; k++) print_limit(&res_limits[k], hard && !soft, true);
+        return 0;
+    }
+    if (!argv[i]) {
+        print_limit(l, hard && !soft, false);
+        return 0;
+    }
+
+    rlim_t v;
+    if (!parse_value(argv[i], l->unit, false, &v)) {
+        fprintf(stderr, "ulimit: %s: invalid number\n", argv[i]);
+        return 1;
+    }
+    if (v != RLIM_INFINITY && v / l->unit != strtoull(argv[i], NULL, 10)) {
+        fprintf(stderr, "ulimit: %s: value too large\n", argv[i]);
+        return 1;
+    }
+    struct rlimit rl;
+    if (getrlimit(l->resource, &rl) < 0) {
+        perror("ulimit");
+        return 1;
+    }
+    // neither -S nor -H: set both
+    if (soft || !hard) rl.rlim_cur = v;
+    if (hard || !soft) rl.rlim_max = v;
+    if (setrlimit(l->resource, &rl) < 0) {
+        fprintf(stderr, "ulimit: %s: cannot modify limit: %s\n", l->desc, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/resource.h>
+
+/* Per-command resource control. Prefix words before a command:
+*   nice [-n N | -N] cmd        add N (default 10) to the niceness; also
+*                               --adjustment=N, other forms run nice(1)
+*   cpus LIST cmd               run only on CPUs LIST, e.g. 0-3,6
+*   limit KEY=VAL[,...] cmd     cap mem, data, stack, fsize, core (bytes,
+*                               K/M/G/T), cpu (seconds), files, procs
+* The executor strips them and applies them in the child between fork
+* and exec (setpriority, sched_setaffinity, setrlimit): no process of
+* their own, and everything the command starts inherits them. They
+* combine with each other and with timeout; in a pipeline each stage
+* takes its own. The ulimit builtin sets the same limits on the shell.
+*/
+
+#define RES_MAX_LIMITS 8
+
+typedef struct {
+    bool set_nice;
+    int nice;               // increment
+    bool set_cpus;
+    cpu_set_t cpus;
+    size_t num_limits;
+    struct {
+        int resource;
+        rlim_t value;       // soft and hard
+    } limits[RES_MAX_LIMITS];
+} ResourceSpec;
+
+void res_init(ResourceSpec *spec);
+
+/* Parse one prefix at argv[0] into spec. Returns the words it took (0 if
+* argv[0] is not a prefix), or -1 after printing an error.
+*/
+int res_parse_prefix(char **argv, ResourceSpec *spec);
+
+// In the child: apply spec; false (after a message) if a limit failed
+bool res_apply(const ResourceSpec *spec);
+
+// ulimit [-SHa] [-c|-d|-f|-l|-n|-s|-t|-u|-v] [VALUE|unlimited]
+int res_ulimit(char **argv);
+
+#endif // RESOURCES_H
@@ -0,0 +1,333 @@
+#include "server.h"
+#include "builtins.h"
+#include "executor.h"
+#include "parsecache.h"
+#include "dirs.h"
+#include "vars.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SERVER_MAX_PENDING 64        // connections still sending a request
+#define REQUEST_TIMEOUT_MS 5000      // to send the whole request
+
+extern ShellState shell_state;
+
+// One client request, as received by the server
+typedef struct {
+    int fds[3];         // client's stdin, stdout, stderr
+    char *payload;      // "CWD\0COMMAND\0ENV..."
+    size_t len;
+} Request;
+
+// A connection whose request is still arriving
+typedef struct {
+    int conn;
+    Request req;
+    bool have_header;   // fds and length received, payload allocated
+    size_t got;         // payload bytes so far
+    int64_t deadline;   // ms, monotonic: dropped if not complete by then
+} Pending;
+
+/* ---------- Helpers ---------- */
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void write_int(int fd, int32_t v) {
+    while (write(fd, &v, sizeof v) < 0 && errno == EINTR) {}
+}
+
+static void close_request(Request *req) {
+    for (int i = 0; i < 3; i++) {
+        if (req->fds[i] >= 0) close(req->fds[i]);
+    }
+    free(req->payload);
+}
+
+/* Receive the fds and payload length from a non-blocking connection.
+ * Returns 0, 1 if nothing has arrived yet, or -1 for a malformed request.
+ */
+static int recv_header(int conn, Request *req) {
+    uint32_t len = 0;
+    struct iovec iov = { &len, sizeof len };
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } ctl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof ctl.buf;
+
+    ssize_t n;
+    while ((n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+    struct cmsghdr *c = n == (ssize_t)sizeof len ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (!c || c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS ||
+        c->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+        return -1;
+    }
+    memcpy(req->fds, CMSG_DATA(c), 3 * sizeof(int));
+
+    if (len < 2 || len > SERVER_MAX_PAYLOAD) return -1;
+    req->payload = malloc(len + 1);
+    if (!req->payload) return -1;
+    req->len = len;
+    return 0;
+}
+
+/* Read what has arrived of p's request, without blocking.
+ * Returns 0 once it is complete, 1 while more is to come, -1 if malformed.
+ */
+static int recv_request(Pending *p) {
+    Request *req = &p->req;
+    if (!p->have_header) {
+        int rc = recv_header(p->conn, req);
+        if (rc != 0) return rc;
+        p->have_header = true;
+    }
+    while (p->got < req->len) {
+        ssize_t n = read(p->conn, req->payload + p->got, req->len - p->got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+        if (n <= 0) return -1;
+        p->got += (size_t)n;
+    }
+    req->payload[req->len] = '\0';
+
+    // need at least the CWD and COMMAND strings
+    const char *nul = memchr(req->payload, '\0', req->len);
+    if (!nul || !memchr(nul + 1, '\0', req->len - (size_t)(nul + 1 - req->payload))) return -1;
+    return 0;
+}
+
+static void close_pending(Pending *p) {
+    close_request(&p->req);
+    close(p->conn);
+}
+
+/* ---------- Worker ---------- */
+static pid_t worker_pid = 0;
+
+// Report the exit status to the client, also when `exit` ends the worker
+static void report_status(int status, void *conn) {
+    if (getpid() != worker_pid) return;     // a forked command child
+    fflush(stdout);
+    write_int((int)(intptr_t)conn, (int32_t)status);
+}
+
+// In the forked worker: adopt the client's fds, cwd and environment
+static void run_worker(int conn, Request *req, JobList *list) {
+    setpgid(0, 0);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    for (int i = 0; i < 3; i++) {
+        if (req->fds[i] == i) continue;
+        dup2(req->fds[i], i);
+        close(req->fds[i]);
+    }
+    worker_pid = getpid();
+    write_int(conn, (int32_t)worker_pid);
+    on_exit(report_status, (void *)(intptr_t)conn);
+
+    const char *cwd = req->payload;
+    const char *end = req->payload + req->len;
+    const char *env = cwd + strlen(cwd) + 1;
+    env += strlen(env) + 1;     // skip the command (already parsed)
+
+    size_t count = 0;
+    for (const char *e = env; e < end; e += strlen(e) + 1) count++;
+    char **envp = calloc(count + 1, sizeof *envp);
+    count = 0;
+    for (const char *e = env; e < end; e += strlen(e) + 1) envp[count++] = (char *)e;
+    vars_free();
+    vars_init(envp);
+    free(envp);
+
+    shell_state.shell_pid = getpid();
+    shell_state.last_status = 0;
+    int status;
+    if (chdir(cwd) < 0) {
+        perror(cwd);
+        exit(1);
+    }
+    dirs_init();    // the client's $PWD, if it names cwd
+
+    if (list->incomplete) {
+        fprintf(stderr, "syntax error: unexpected end of file\n");
+        status = 2;
+    } else {
+        status = list->error ? 2 : execute_list(list);
+    }
+    exit(status);
+}
+
+/* ---------- Server loop ---------- */
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    // replace a stale socket from an earlier server, but nothing else
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s: exists and is not a socket\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    // only the owner may connect: the socket runs commands as us
+    mode_t old_mask = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof addr);
+    umask(old_mask);
+    if (rc < 0 || chmod(path, 0600) < 0 || listen(fd, 64) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The connecting process runs as our effective uid
+static bool peer_allowed(int conn) {
+    struct ucred cred;
+    socklen_t len = sizeof cred;
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) return false;
+    if (cred.uid == geteuid()) return true;
+    fprintf(stderr, "server: refused connection from uid %d\n", (int)cred.uid);
+    return false;
+}
+
+/* Start a worker for the complete request pending[k]. The worker must
+ * not keep the other connections' sockets and client fds open.
+ */
+static void dispatch(int lfd, Pending *pending, size_t num_pending, size_t k,
+                     size_t *active) {
+    Pending *p = &pending[k];
+
+    // parse here so repeated commands hit the server's parse cache
+    const char *command = p->req.payload + strlen(p->req.payload) + 1;
+    JobList *list = pcache_parse(command);
+
+    int flags = fcntl(p->conn, F_GETFL);
+    if (flags >= 0) fcntl(p->conn, F_SETFL, flags & ~O_NONBLOCK);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(lfd);
+        for (size_t i = 0; i < num_pending; i++) {
+            if (i != k) close_pending(&pending[i]);
+        }
+        run_worker(p->conn, &p->req, list);
+    }
+    if (pid < 0) {
+        perror("fork");
+        write_int(p->conn, -1);
+    } else {
+        (*active)++;
+    }
+    pcache_release(list);
+    close_pending(p);
+}
+
+int server_run(const char *path, size_t max_clients) {
+    int lfd = listen_on(path);
+    if (lfd < 0) return 1;
+    signal(SIGPIPE, SIG_IGN);
+    if (max_clients == 0) max_clients = 1;
+
+    // requests arrive concurrently: a client that connects and sends
+    // nothing holds up no one, and is dropped after REQUEST_TIMEOUT_MS
+    Pending pending[SERVER_MAX_PENDING];
+    size_t num_pending = 0;
+    size_t active = 0;
+    for (;;) {
+        // reap finished workers; block while at the client limit
+        while (active > 0) {
+            pid_t pid = waitpid(-1, NULL, active >= max_clients ? 0 : WNOHANG);
+            if (pid < 0 && errno == EINTR) continue;
+            if (pid <= 0) break;
+            active--;
+        }
+
+        struct pollfd pfds[SERVER_MAX_PENDING + 1];
+        size_t nfds = 0;
+        bool listening = num_pending < SERVER_MAX_PENDING;
+        if (listening) pfds[nfds++] = (struct pollfd){ lfd, POLLIN, 0 };
+        int64_t now = now_ms();
+        int timeout = -1;
+        for (size_t i = 0; i < num_pending; i++) {
+            pfds[nfds++] = (struct pollfd){ pending[i].conn, POLLIN, 0 };
+            int64_t left = pending[i].deadline - now;
+            if (left < 0) left = 0;
+            if (timeout < 0 || left < timeout) timeout = (int)left;
+        }
+        if (poll(pfds, nfds, timeout) < 0) {
+            if (errno != EINTR) perror("poll");
+            continue;
+        }
+
+        // backwards, so removing one moves only an already handled entry
+        size_t base = listening ? 1 : 0;
+        now = now_ms();
+        for (size_t i = num_pending; i-- > 0;) {
+            Pending *p = &pending[i];
+            int rc = pfds[base + i].revents ? recv_request(p) : 1;
+            if (rc > 0 && now < p->deadline) continue;
+            if (rc == 0) dispatch(lfd, pending, num_pending, i, &active);
+            else close_pending(p);
+            pending[i] = pending[--num_pending];
+        }
+
+        if (!listening || !(pfds[0].revents & POLLIN)) continue;
+        int conn = accept4(lfd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (conn < 0) {
+            if (errno != EINTR && errno != EAGAIN) perror("accept");
+            continue;
+        }
+        if (!peer_allowed(conn)) {
+            close(conn);
+            continue;
+        }
+        Pending *p = &pending[num_pending++];
+        memset(p, 0, sizeof *p);
+        p->conn = conn;
+        p->req.fds[0] = p->req.fds[1] = p->req.fds[2] = -1;
+        p->deadline = now_ms() + REQUEST_TIMEOUT_MS;
+    }
+}
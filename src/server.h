@@ -0,0 +1,27 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Server mode: a warm shell listening on a Unix domain socket.
+* Protocol, per connection (all integers in host byte order):
+*   client -> server: one message carrying the client's fds 0, 1 and 2
+*                     as SCM_RIGHTS, with a uint32_t payload length;
+*                     then the payload "CWD\0COMMAND\0NAME=value\0..."
+*   server -> client: int32_t pid of the worker (its process group, so
+*                     the client can forward signals), then int32_t
+*                     exit status once the command finishes
+* The server parses the command (warming its parse cache) and forks a
+* worker that runs it on the client's fds, cwd and environment.
+* Requests are read from all connections at once (poll), so a client
+* that stalls delays no one; it is dropped after 5 s.
+*/
+
+#define SERVER_MAX_PAYLOAD (16u << 20)
+#define SERVER_DEFAULT_CLIENTS 16
+
+// Listen on path and serve forever; returns an exit status on failure
+int server_run(const char *path, size_t max_clients);
+
+#endif // SERVER_H
@@ -0,0 +1,123 @@
+#include "sharedhist.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHIST_MAGIC 0x6d796873u     // "myhs"
+#define SHIST_SLOTS 4096
+#define SHIST_LINE  1000            // longer lines stay local
+
+typedef struct {
+    _Atomic uint64_t seq;           // sequence published here, 0 while written
+    uint32_t session;               // session that typed the line
+    char line[SHIST_LINE];
+} Slot;
+
+typedef struct {
+    _Atomic uint32_t magic;
+    _Atomic uint64_t next;          // last sequence reserved (0: none yet)
+    Slot slots[SHIST_SLOTS];
+} Ring;
+
+static Ring *ring = NULL;
+static uint64_t seen = 0;           // last sequence imported
+static uint32_t self = 0;           // this session's id
+
+bool shist_enabled(void) {
+    return ring != NULL;
+}
+
+bool shist_open(History *h) {
+    if (ring) return true;
+
+    char name[64];
+    snprintf(name, sizeof name, "/myshell-hist-%u", (unsigned)getuid());
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror("shm_open");
+        return false;
+    }
+    // a fresh object is zero-filled, which is a valid empty ring
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        (st.st_size < (off_t)sizeof(Ring) && ftruncate(fd, sizeof(Ring)) < 0)) {
+        perror("sharehist");
+        close(fd);
+        return false;
+    }
+    void *mem = mmap(NULL, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+
+    Ring *r = mem;
+    uint32_t magic = 0;
+    if (!atomic_compare_exchange_strong(&r->magic, &magic, SHIST_MAGIC) &&
+        magic != SHIST_MAGIC) {
+        fprintf(stderr, "sharehist: %s has an unknown layout\n", name);
+        munmap(mem, sizeof(Ring));
+        return false;
+    }
+
+    ring = r;
+    // pid plus start time: a recycled pid is still another session
+    self = (uint32_t)getpid() ^ ((uint32_t)time(NULL) << 16);
+    seen = 0;
+    shist_import(h);
+    return true;
+}
+
+void shist_close(void) {
+    if (ring) munmap(ring, sizeof(Ring));
+    ring = NULL;
+}
+
+void shist_append(const char *line) {
+    if (!ring) return;
+    size_t len = strlen(line);
+    if (len >= SHIST_LINE) return;
+
+    uint64_t seq = atomic_fetch_add(&ring->next, 1) + 1;
+    Slot *s = &ring->slots[seq % SHIST_SLOTS];
+    atomic_store_explicit(&s->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s->session = self;
+    memcpy(s->line, line, len + 1);
+    atomic_store_explicit(&s->seq, seq, memory_order_release);
+}
+
+void shist_import(History *h) {
+    if (!ring) return;
+    uint64_t next = atomic_load_explicit(&ring->next, memory_order_acquire);
+    if (next - seen > SHIST_SLOTS) seen = next - SHIST_SLOTS;   // overwritten
+
+    char line[SHIST_LINE];
+    for (uint64_t seq = seen + 1; seq <= next; seq++) {
+        Slot *s = &ring->slots[seq % SHIST_SLOTS];
+        uint64_t got = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (got != seq) {
+            // being written: look again next time, unless it is old enough
+            // that the writer must have died mid-copy
+            if (got < seq && next - seq < 16) break;
+            seen = seq;
+            continue;
+        }
+        uint32_t session = s->session;
+        memcpy(line, s->line, sizeof line);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) != seq) break;
+        line[sizeof line - 1] = '\0';
+
+        if (session != self) history_add(h, line);
+        seen = seq;
+    }
+}
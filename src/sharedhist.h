@@ -0,0 +1,29 @@
+#ifndef SHAREDHIST_H
+#define SHAREDHIST_H
+
+#include "history.h"
+
+#include <stdbool.h>
+
+/* Shared history (set -o sharehist).
+* All of a user's sessions append to one ring in POSIX shared memory
+* (/myshell-hist-UID). A writer reserves a slot with an atomic
+* fetch-and-add on the sequence counter and publishes the line by
+* storing its sequence number last; readers copy a slot and keep it
+* only if the sequence is unchanged afterwards (no locks anywhere).
+* Other sessions' lines are imported into the local History, so local
+* numbers for !N only ever grow. The ring outlives the sessions.
+*/
+
+// Map the ring and import what is already there; false if unavailable
+bool shist_open(History *h);
+void shist_close(void);
+bool shist_enabled(void);
+
+// Publish a line typed in this session
+void shist_append(const char *line);
+
+// Add lines from other sessions published since the last import
+void shist_import(History *h);
+
+#endif // SHAREDHIST_H
@@ -4,21 +4,91 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+struct Job;
+struct Compound;
+
+// Kind of command: a simple command or a compound command from the grammar
+typedef enum {
+    CMD_SIMPLE,
+    CMD_IF,
+    CMD_WHILE,
+    CMD_UNTIL,
+    CMD_FOR,
+    CMD_CASE,
+    CMD_FUNCDEF,
+    CMD_GROUP,              // { list; }: runs in the shell itself
+    CMD_SUBSHELL,           // ( list ): runs in a child process
+    CMD_COPROC              // coproc [NAME] command: body runs as a coprocess
+} CommandKind;
+
+// Redirection operators
+typedef enum {
+    REDIR_INPUT,            // [N]<file
+    REDIR_OUTPUT,           // [N]>file (truncate)
+    REDIR_APPEND,           // [N]>>file
+    REDIR_DUP,              // [N]>&M, [N]<&M (M may be "-" to close N)
+    REDIR_OUTPUT_BOTH,      // &>file: stdout and stderr
+    REDIR_APPEND_BOTH,      // &>>file
+    REDIR_HEREDOC,          // [N]<<WORD, [N]<<-WORD: target is the body
+    REDIR_HERESTRING        // [N]<<<word: target word plus a newline
+} RedirKind;
+
+// One redirection; a command's redirections are applied in order
+typedef struct {
+    RedirKind kind;
+    int fd;                 // file descriptor being redirected
+    char *target;           // file name or fd word (expanded at run time)
+} Redirection;
+
 // Single command in a pipeline
 typedef struct {
+    CommandKind kind;
     char **argv;            // null-terminated argument list
-    char *input_file;       // "<" redirection
-    char *output_file;      // ">" redirection
-    char *error_file;       // "2>" redirection
+    char **assigns;         // leading NAME=value words, null-terminated (or NULL)
+    Redirection *redirs;    // redirections in source order
+    size_t num_redirs;
+    struct Compound *compound; // body of a compound command (kind != CMD_SIMPLE)
 } Command;
 
 // A full job which may include multiple commands
-typedef struct {
+typedef struct Job {
     Command *commands;      // array of commands
     size_t num_cmds;        // number of commands
     bool background;        // ends with &
     bool sequential;        // ends with ;
+    bool and_if;            // ends with &&: next job runs only on success
+    bool or_if;             // ends with ||: next job runs only on failure
 } Job;
 
+// A sequence of jobs: a whole input line, or the body of a compound command
+typedef struct JobList {
+    Job **jobs;
+    size_t count;
+    bool incomplete;        // parse ran out of input inside a construct
+    bool error;             // parse hit a syntax error
+} JobList;
+
+// One "pattern | pattern ) list ;;" arm of a case command
+typedef struct {
+    char **patterns;        // null-terminated
+    JobList body;
+} CaseItem;
+
+/* Parsed body of a compound command.
+* Immutable once parsed and reference counted, so loop and function
+* bodies are executed many times straight from the tree.
+*/
+typedef struct Compound {
+    size_t refcount;
+    JobList cond;           // if/while/until condition
+    JobList body;           // then/do/function/group body
+    JobList else_part;      // else branch (elif is a nested if)
+    char *name;             // for variable, function name, coproc NAME
+    char **words;           // for ... in words / case subject (words[0])
+    bool has_in;            // for loop had an "in" list
+    CaseItem *items;        // case arms
+    size_t num_items;
+} Compound;
+
 
 #endif // SHELLTYPES_H
@@ -0,0 +1,237 @@
+#include "vars.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Each slot keeps its variable as one "NAME=value" string so the
+* cached envp can point straight at the entries without copying.
+*/
+typedef struct {
+    char *entry;        // "NAME=value", NULL if empty/tombstone
+    size_t name_len;    // length of NAME
+    uint32_t hash;
+    bool exported;
+    bool tombstone;     // deleted slot, keeps probe chains intact
+} VarSlot;
+
+static VarSlot *slots = NULL;
+static size_t slot_cap = 0;     // power of two
+static size_t slot_used = 0;    // live entries
+static size_t slot_filled = 0;  // live entries + tombstones
+
+static char **envp_cache = NULL;
+static bool envp_dirty = true;
+
+/* ---------- Hash table ---------- */
+static uint32_t hash_name(const char *s, size_t len) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static VarSlot *find_slot(const char *name, size_t len, uint32_t h) {
+    if (slot_cap == 0) return NULL;
+    size_t mask = slot_cap - 1;
+    for (size_t i = h & mask; ; i = (i + 1) & mask) {
+        VarSlot *s = &slots[i];
+        if (!s->entry && !s->tombstone) return NULL;
+        if (s->entry && s->hash == h && s->name_len == len &&
+            memcmp(s->entry, name, len) == 0) {
+            return s;
+        }
+    }
+}
+
+static void rehash(size_t new_cap) {
+    VarSlot *old = slots;
+    size_t old_cap = slot_cap;
+
+    slots = calloc(new_cap, sizeof *slots);
+    slot_cap = new_cap;
+    slot_filled = slot_used;
+
+    size_t mask = new_cap - 1;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i].entry) continue;
+        size_t j = old[i].hash & mask;
+        while (slots[j].entry) j = (j + 1) & mask;
+        slots[j] = old[i];
+        slots[j].tombstone = false;
+    }
+    free(old);
+}
+
+// Find the slot for name, inserting an empty one if missing
+static VarSlot *insert_slot(const char *name, size_t len, uint32_t h) {
+    VarSlot *s = find_slot(name, len, h);
+    if (s) return s;
+
+    // keep load (including tombstones) under 3/4
+    if ((slot_filled + 1) * 4 > slot_cap * 3) {
+        size_t cap = slot_cap ? slot_cap : 64;
+        while ((slot_used + 1) * 2 > cap) cap *= 2;
+        rehash(cap);
+    }
+
+    size_t mask = slot_cap - 1;
+    size_t i = h & mask;
+    while (slots[i].entry) i = (i + 1) & mask;
+    if (!slots[i].tombstone) slot_filled++;
+    slots[i].tombstone = false;
+    slots[i].hash = h;
+    slots[i].name_len = len;
+    slots[i].exported = false;
+    slot_used++;
+    return &slots[i];
+}
+
+/* ---------- Public API ---------- */
+bool var_valid_name(const char *s, size_t len) {
+    if (!s || len == 0) return false;
+    if (!(isalpha((unsigned char)s[0]) || s[0] == '_')) return false;
+    for (size_t i = 1; i < len; i++) {
+        if (!(isalnum((unsigned char)s[i]) || s[i] == '_')) return false;
+    }
+    return true;
+}
+
+void vars_init(char **envp) {
+    rehash(64);
+    if (!envp) return;
+    for (size_t i = 0; envp[i]; i++) {
+        var_assign(envp[i], true);
+    }
+    envp_dirty = true;
+}
+
+void vars_free(void) {
+    for (size_t i = 0; i < slot_cap; i++) free(slots[i].entry);
+    free(slots);
+    free(envp_cache);
+    slots = NULL;
+    envp_cache = NULL;
+    slot_cap = slot_used = slot_filled = 0;
+    envp_dirty = true;
+}
+
+const char *var_get(const char *name) {
+    size_t len = strlen(name);
+    VarSlot *s = find_slot(name, len, hash_name(name, len));
+    return s ? s->entry + len + 1 : NULL;
+}
+
+bool var_is_exported(const char *name) {
+    size_t len = strlen(name);
+    VarSlot *s = find_slot(name, len, hash_name(name, len));
+    return s && s->exported;
+}
+
+static bool set_len(const char *name, size_t len, const char *value, bool exported) {
+    if (!var_valid_name(name, len)) return false;
+    if (!value) value = "";
+
+    size_t vlen = strlen(value);
+    char *entry = malloc(len + 1 + vlen + 1);
+    if (!entry) return false;
+    memcpy(entry, name, len);
+    entry[len] = '=';
+    memcpy(entry + len + 1, value, vlen + 1);
+
+    VarSlot *s = insert_slot(name, len, hash_name(name, len));
+    free(s->entry);
+    s->entry = entry;
+    if (exported) s->exported = true;
+    if (s->exported) envp_dirty = true;
+    return true;
+}
+
+bool var_set(const char *name, const char *value, bool exported) {
+    return set_len(name, strlen(name), value, exported);
+}
+
+bool var_assign(const char *assignment, bool exported) {
+    const char *eq = strchr(assignment, '=');
+    if (!eq) return false;
+    return set_len(assignment, (size_t)(eq - assignment), eq + 1, exported);
+}
+
+bool var_export(const char *name) {
+    size_t len = strlen(name);
+    if (!var_valid_name(name, len)) return false;
+    uint32_t h = hash_name(name, len);
+    VarSlot *s = find_slot(name, len, h);
+    if (!s) return set_len(name, len, "", true);
+    if (!s->exported) {
+        s->exported = true;
+        envp_dirty = true;
+    }
+    return true;
+}
+
+bool var_unset(const char *name) {
+    size_t len = strlen(name);
+    VarSlot *s = find_slot(name, len, hash_name(name, len));
+    if (!s) return false;
+    if (s->exported) envp_dirty = true;
+    free(s->entry);
+    s->entry = NULL;
+    s->exported = false;
+    s->tombstone = true;
+    slot_used--;
+    return true;
+}
+
+char **vars_envp(void) {
+    if (!envp_dirty && envp_cache) return envp_cache;
+
+    size_t n = 0;
+    for (size_t i = 0; i < slot_cap; i++) {
+        if (slots[i].entry && slots[i].exported) n++;
+    }
+    char **envp = realloc(envp_cache, (n + 1) * sizeof *envp);
+    if (!envp) return envp_cache;
+
+    size_t k = 0;
+    for (size_t i = 0; i < slot_cap; i++) {
+        if (slots[i].entry && slots[i].exported) envp[k++] = slots[i].entry;
+    }
+    envp[k] = NULL;
+
+    envp_cache = envp;
+    envp_dirty = false;
+    return envp_cache;
+}
+
+static int cmp_entry(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void vars_print(bool exported_only) {
+    char **list = malloc((slot_used + 1) * sizeof *list);
+    if (!list) return;
+
+    size_t n = 0;
+    for (size_t i = 0; i < slot_cap; i++) {
+        if (!slots[i].entry) continue;
+        if (exported_only && !slots[i].exported) continue;
+        list[n++] = slots[i].entry;
+    }
+    qsort(list, n, sizeof *list, cmp_entry);
+
+    for (size_t i = 0; i < n; i++) {
+        const char *eq = strchr(list[i], '=');
+        int name_len = (int)(eq - list[i]);
+        if (exported_only) {
+            printf("export %.*s=\"%s\"\n", name_len, list[i], eq + 1);
+        } else {
+            printf("%s\n", list[i]);
+        }
+    }
+    free(list);
+}
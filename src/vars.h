@@ -0,0 +1,35 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Shell variables.
+* Stored in an open-addressing hash table (linear probing).
+* Exported variables make up the environment passed to children;
+* the envp array is cached and only rebuilt after an exported
+* variable changes.
+*/
+
+void vars_init(char **envp);
+void vars_free(void);
+
+const char *var_get(const char *name);
+bool var_set(const char *name, const char *value, bool exported);
+bool var_export(const char *name);
+bool var_unset(const char *name);
+bool var_is_exported(const char *name);
+
+// true if s[0..len) is a valid variable name
+bool var_valid_name(const char *s, size_t len);
+
+// Split "NAME=value" and set it. Returns false on an invalid name.
+bool var_assign(const char *assignment, bool exported);
+
+// Cached NULL-terminated "NAME=value" array of exported variables
+char **vars_envp(void);
+
+// Print variables sorted by name, either as `export NAME="value"` or NAME=value
+void vars_print(bool exported_only);
+
+#endif // VARS_H